@@ -24,132 +24,101 @@
 #include <fcntl.h>
 #include <unistd.h>
 #include <sys/ioctl.h>
+#include <stdlib.h>
 #include <string.h>
+#include <getopt.h>
+#include <signal.h>
+#include <time.h>
+#include <stddef.h>
+#include <poll.h>
+#include <errno.h>
 #include "jm_crc.h"
 #include "sata_xor.h"
 #include "jmraid.h"
-#include <asm/byteorder.h> // For __le32_to_cpu etc
+#include "jm_cmd.h"
+#include "jm_wakeup.h"
+#include "jm_daemon.h"
+#include "jm_shm.h"
+#include "jm_async.h"
+#include "jm_buf.h"
+#include "jm_cache.h"
+#include "jm_out.h"
+#include "jm_http.h"
+#include "jm_wheel.h"
+#include "jm_idle.h"
+#include "jm_uevent.h"
 
 #define SECTORSIZE (512)
-#define READ_CMD (0x28)
-#define WRITE_CMD (0x2a)
-#define RW_CMD_LEN (10)
 
-#define JM_RAID_WAKEUP_CMD    ( 0x197b0325 )
 //#define JM_RAID_SCRAMBLED_CMD ( 0x197b0322 ) // JMB39x
 //#define JM_RAID_SCRAMBLED_CMD ( 0x197b0562 ) // JMS56x
 
-int g_print_indent = 0;
+// Only for the output, the device state lives in struct jmraid
+static int g_print_indent = 0;
+static FILE *g_print_file = NULL; // g_out unless set
+static struct jm_out g_out;        // Everything for stdout, written in one go at exit
+static int g_format = -1;          // --format, JM_OUT_* records instead of text
 
 // uint8_t g_tempBuf2[SECTORSIZE];
-uint32_t g_cmdNum = 1;
 
 // First 4 bytes are always the same for all the scrambled commands, next 4 bytes forms an incrementing command id
 // (and these 8 bytes are now automatically prepended and no longer listed here)
 // The Identify disk commands does not return the data in the same format as the normal IDENTIFY DEVICE!??
 //const uint8_t probe16[] ={ 0x00, 0x03, 0x02, 0xff, 0x00, 0x00, 0x00, 0x00, 0x00 }; // AWARD I5, wtf??  // jmraid_get_raid_port_info port 0?
-const uint8_t getraidportinfo_probe[] ={ 0x00, 0x03, 0x02, 0xff, 0x00 }; // AWARD I5, wtf??  // jmraid_get_raid_port_info port 0?
-//const uint8_t getraidportinfo_probe[] ={ 0x00, 0x03, 0x02, 0xff, 0x01 }; // AWARD I5, wtf??  // jmraid_get_raid_port_info port 0?
+//const uint8_t getraidportinfo_probe[] ={ 0x00, 0x03, 0x02, 0xff, 0x00 }; // AWARD I5, wtf??  // jmraid_get_raid_port_info port 0?
 const uint8_t getchipinfo_probe[]     ={ 0x00, 0x01, 0x01, 0xff }; // jmraid_get_chip_info
 const uint8_t getsatainfo_probe[]     ={ 0x00, 0x02, 0x01, 0xff }; // jmraid_get_sata_info
-const uint8_t getsataport0info_probe[]={ 0x00, 0x02, 0x02, 0x00, 0x00, 0xff }; // jmraid_get_sata_port_info port 0
-const uint8_t getsataport1info_probe[]={ 0x00, 0x02, 0x02, 0x00, 0x01, 0xff }; // jmraid_get_sata_port_info port 1
-const uint8_t disk0smartread1_probe[]={ 0x00, 0x02, 0x03, 0xff, 0x00, 0x02, 0x00, 0xe0, 0x00, 0x00,         // disk0 ata passthrough
-        0xd0, 0x00, 0x00, 0x00, 0x00, 0x00, 0x4f, 0x00, 0xc2, 0x00, 0xa0, 0x00, 0xb0, 0x00 };               // SMART READ ATTRIBUTE VALUE ata cmd
-const uint8_t disk0smartread2_probe[]={ 0x00, 0x02, 0x03, 0xff, 0x00, 0x02, 0x00, 0xe0, 0x00, 0x00,         // disk0 ata passthrough, again
-        0xd1, 0x00, 0x00, 0x00, 0x00, 0x00, 0x4f, 0x00, 0xc2, 0x00, 0xa0, 0x00, 0xb0, 0x00 };               // SMART READ ATTRIBUTE THRESHOLDS ata cmd
-const uint8_t disk1smartread1_probe[]={ 0x00, 0x02, 0x03, 0xff, 0x01, 0x02, 0x00, 0xe0, 0x00, 0x00,         // disk1 ata passthrough
-        0xd0, 0x00, 0x00, 0x00, 0x00, 0x00, 0x4f, 0x00, 0xc2, 0x00, 0xa0, 0x00, 0xb0, 0x00 };               // SMART READ ATTRIBUTE VALUE ata cmd
-const uint8_t disk1smartread2_probe[]={ 0x00, 0x02, 0x03, 0xff, 0x01, 0x02, 0x00, 0xe0, 0x00, 0x00,         // disk1 ata passthrough, again
-        0xd1, 0x00, 0x00, 0x00, 0x00, 0x00, 0x4f, 0x00, 0xc2, 0x00, 0xa0, 0x00, 0xb0, 0x00 };               // SMART READ ATTRIBUTE THRESHOLDS ata cmd
-
-
-    sg_io_hdr_t io_hdr;
-#warning FIXME: Should not use a hard-coded sector number (0x21) (or 0xfe), even though it is backed up and restored afterwards
-    uint8_t rwCmdBlk[RW_CMD_LEN] =
-                    {READ_CMD, 0x00, 0x00, 0x00, 0x00, 0xfe, 0x00, 0x00, 0x01, 0x00}; // SECTOR NUMBER 0xfe!!!!!!
-
-uint32_t Do_JM_Cmd( int theFD, uint32_t* theCmd, uint32_t* theResp ) {
-    uint32_t retval=0;
-
-    // Calculate CRC for the request
-    uint32_t myCRC = JM_CRC( theCmd, 0x7f );
-
-    // Stash the CRC at the end
-    theCmd[0x7f] = __cpu_to_le32( myCRC );
-//    printf("Command CRC: 0x%08x\n", myCRC);
-
-    // Make the data look really 31337 (or not)
-    SATA_XOR( theCmd );
-
-    io_hdr.dxfer_direction = SG_DXFER_TO_DEV;
-    rwCmdBlk[0] = WRITE_CMD;
-    io_hdr.dxferp = theCmd;
-    ioctl(theFD, SG_IO, &io_hdr);
-
-    io_hdr.dxfer_direction = SG_DXFER_FROM_DEV;
-    rwCmdBlk[0] = READ_CMD;
-    io_hdr.dxferp = theResp;
-    ioctl(theFD, SG_IO, &io_hdr);
-
-    // Make the 31337-looking response sane
-    SATA_XOR( theResp );
-
-    myCRC = JM_CRC( theResp, 0x7f);
-    if( myCRC != __le32_to_cpu( theResp[0x7f] ) ) {
-        printf( "Warning: Response CRC 0x%08x does not match the calculated 0x%08x!!\n", __le32_to_cpu( theResp[0x7f] ), myCRC );
-        retval=1;
-    }
-    return retval;
-}
 
-void send_cmd(
-        int theFD,
-        uint32_t scrambled_cmd,
-        uint8_t* theCmd,
-        uint32_t theLen,
-        uint8_t* resultBuf)
-{
-    uint8_t tempBuf1[SECTORSIZE];
-    uint32_t* tempBuf1_32 = (uint32_t*)tempBuf1;
-
-    // Entire sector is always sent, so zero fill cmd
-    memset( tempBuf1, 0, SECTORSIZE );
-    memcpy( tempBuf1+0x08, theCmd, theLen );
-
-    tempBuf1_32[0] = __cpu_to_le32( scrambled_cmd );
-    tempBuf1_32[1] = __cpu_to_le32( g_cmdNum++ );
-    theLen+=0x08; // Adding the SCRAMBLED_CMD and command number
-
-    Do_JM_Cmd( theFD, (uint32_t*)tempBuf1, (uint32_t*)resultBuf);
-}
- 
-void process_cmd(
-        int theFD,
-        uint32_t scrambled_cmd,
-        uint8_t* theCmd,
-        uint32_t theLen,
-        uint8_t result_offset,
-        void (*parse_and_print)(const uint8_t*)) {
-    const uint8_t *resultBuf = malloc(SECTORSIZE);
-    send_cmd(theFD, scrambled_cmd, theCmd, theLen, resultBuf);
-    const uint8_t *info = resultBuf + result_offset;
-    (*parse_and_print)(info);
-    free(resultBuf);
+// The controller has five SATA ports and up to five RAID ports (volumes)
+#define JM_PORTS (5)
+
+#define RAIDPORTINFO_PROBE(n) { 0x00, 0x03, 0x02, 0xff, n }             // jmraid_get_raid_port_info
+#define SATAPORTINFO_PROBE(n) { 0x00, 0x02, 0x02, 0x00, n, 0xff }       // jmraid_get_sata_port_info
+
+const uint8_t getraidportinfo_probe[JM_PORTS][5] = {
+    RAIDPORTINFO_PROBE(0), RAIDPORTINFO_PROBE(1), RAIDPORTINFO_PROBE(2), RAIDPORTINFO_PROBE(3), RAIDPORTINFO_PROBE(4) };
+const uint8_t getsataportinfo_probe[JM_PORTS][6] = {
+    SATAPORTINFO_PROBE(0), SATAPORTINFO_PROBE(1), SATAPORTINFO_PROBE(2), SATAPORTINFO_PROBE(3), SATAPORTINFO_PROBE(4) };
+// ATA passthrough, filled in by build_probes()
+uint8_t smartread1_probe[JM_PORTS][JMRAID_ATA_FRAME_LEN];       // SMART READ ATTRIBUTE VALUE
+uint8_t smartread2_probe[JM_PORTS][JMRAID_ATA_FRAME_LEN];       // SMART READ ATTRIBUTE THRESHOLDS
+
+static void build_probes(void) {
+    struct jmraid_ata_taskfile values, thresholds;
+    int i;
+
+    jmraid_smart_taskfile(&values, JMRAID_SMART_READ_VALUES);
+    jmraid_smart_taskfile(&thresholds, JMRAID_SMART_READ_THRESHOLDS);
+    for (i = 0; i < JM_PORTS; i++) {
+        jmraid_build_ata_passthrough(smartread1_probe[i], i, 0x00, JMRAID_SMART_READ_SIZE, &values);
+        jmraid_build_ata_passthrough(smartread2_probe[i], i, 0x00, JMRAID_SMART_READ_SIZE, &thresholds);
+    }
 }
 
 void print(const char* format, ...)
 {
   va_list arglist;
   int len = g_print_indent * 2;
-  while (len-- > 0)
+  va_start(arglist, format);
+  if (g_print_file)
   {
-    putchar(' ');
+    fprintf(g_print_file, "%*s", len, "");
+    vfprintf(g_print_file, format, arglist);
+  }
+  else
+  {
+    JM_Out_Printf(&g_out, "%*s", len, "");
+    JM_Out_VPrintf(&g_out, format, arglist);
   }
-  va_start(arglist, format);
-  vprintf(format, arglist);
   va_end(arglist);
 }
+
+// What went to stdout directly comes first, then all of g_out
+static void flush_output(void)
+{
+  fflush(stdout);
+  JM_Out_Flush(&g_out);
+}
 const char *get_raid_rebuild_priority_text(uint16_t raid_rebuild_priority)
 {
   // 0x4000 = low, 0x2000 = low-middle, 0x1000 = middle, 0x0800 = middle-high, 0x0400 = high
@@ -204,64 +173,6 @@ const char *get_raid_state_text(uint8_t raid_state)
   }
 }
 
-static uint32_t read_u32_le(const uint8_t *p)
-{
-  return (p[0] << 0) | (p[1] << 8) | (p[2] << 16) | (p[3] << 24);
-}
-
-static uint16_t read_u16_le(const uint8_t *p)
-{
-  return (p[0] << 0) | (p[1] << 8);
-}
-
-static void swap_bytes(uint8_t *data, uint32_t size)
-{
-  while (size > 1)
-  {
-    uint8_t temp;
-    temp = data[0];
-    data[0] = data[1];
-    data[1] = temp;
-    data += 2;
-    size -= 2;
-  }
-}
-
-void parse_jmraid_raid_port_info(const uint8_t *src, struct jmraid_raid_port_info *dst) {
-  const uint8_t *p = src;
-  int i;
-
-  memset(dst, 0, sizeof(struct jmraid_raid_port_info));
-
-  p += 0x04;
-  dst->port_state = p[0x40];
-  memcpy(dst->model_name, p + 0x00, 0x28);
-  swap_bytes(dst->model_name, 0x28);
-  memcpy(dst->serial_number, p + 0x28, 0x14);
-  swap_bytes(dst->serial_number, 0x14);
-  dst->level = p[0x50];
-  dst->capacity = ((uint64_t)read_u32_le(p + 0x3C)) * (32 * 1024 * 1024);
-  dst->state = p[0x42];
-  dst->member_count = p[0x51];
-  dst->rebuild_priority = read_u16_le(p + 0x60);
-  dst->standby_timer = read_u16_le(p + 0x62) * 10;
-  memcpy(dst->password, p + 0x78, 0x08);
-  dst->rebuild_progress =
-      ((uint64_t)read_u32_le(p + 0x5C)) * (32 * 1024 * 1024);
-
-  p += 0xA0;
-  for (i = 0; i < 5; i++) {
-    struct jmraid_raid_port_info_member *member = &dst->member[i];
-    member->ready = p[0x00];
-    member->lba48_support = p[0x04];
-    member->sata_page = p[0x06];
-    member->sata_port = p[0x07];
-    member->sata_base = read_u32_le(p + 0x08);
-    member->sata_size = ((uint64_t)read_u32_le(p + 0x0C)) * (32 * 1024 * 1024);
-    p += 0x20;
-  }
-}
-
 void print_raid_port_info(const struct jmraid_raid_port_info *info)
 {
   if (info->port_state != 0x00)
@@ -400,54 +311,6 @@ const char *get_smart_attribute_name(uint8_t id)
 }
 
 
-/*
-int jmraid_invoke_command_get_chip_info(struct jmraid *jmraid, uint8_t *data_out, uint32_t size_out)
-{
-        uint8_t data_in[2];
-
-        data_in[0] = 0x01;
-        data_in[1] = 0x01;
-
-        if (!jmraid_invoke_command(jmraid, data_in, sizeof(data_in), data_out, size_out))
-        {
-                return 1;
-        }
-
-        return 0;
-}
-
-int jmraid_invoke_command_get_sata_info(struct jmraid *jmraid, uint8_t *data_out, uint32_t size_out)
-{
-        uint8_t data_in[2];
-
-        data_in[0] = 0x02;
-        data_in[1] = 0x01;
-
-        if (!jmraid_invoke_command(jmraid, data_in, sizeof(data_in), data_out, size_out))
-        {
-                return 1;
-        }
-
-        return 0;
-}
-
-int jmraid_invoke_command_get_sata_port_info(struct jmraid *jmraid, uint8_t sata_port, uint8_t *data_out, uint32_t size_out)
-{
-        uint8_t data_in[3];
-
-        data_in[0] = 0x02;
-        data_in[1] = 0x02;
-        data_in[2] = sata_port;
-
-        if (!jmraid_invoke_command(jmraid, data_in, sizeof(data_in), data_out, size_out))
-        {
-                return 1;
-        }
-
-        return 0;
-}
-*/
-
 void print_chip_info(const struct jmraid_chip_info *info)
 {
         print("Firmware version = %02d.%02d.%02d.%02d\n", info->firmware_version[3], info->firmware_version[2], info->firmware_version[1], info->firmware_version[0]);
@@ -456,84 +319,10 @@ void print_chip_info(const struct jmraid_chip_info *info)
         print("Serial number    = %d\n", info->serial_number);
 }
 
-/*
-int jmraid_get_chip_info(struct jmraid *jmraid, struct jmraid_chip_info *info)
-{
-        uint8_t data_out[SECTORSIZE];
-
-
-        if (!jmraid_invoke_command_get_chip_info(jmraid, data_out, sizeof(data_out)))
-        {
-                return 1;
-        }
-
-        parse_jmraid_chip_info(data_out, info);
-
-        return 0;
-}*/
-
-void parse_jmraid_chip_info(const uint8_t *src, struct jmraid_chip_info *dst)
-{
-        const uint8_t *p = src;
-
-        memset(dst, 0, sizeof(struct jmraid_chip_info));
-
-        dst->firmware_version[0] = p[0];
-        dst->firmware_version[1] = p[1];
-        dst->firmware_version[2] = p[2];
-        dst->firmware_version[3] = p[3];
-        memcpy(dst->product_name, p + 0x14, 0x20);
-        memcpy(dst->manufacturer, p + 0x34, 0x20);
-        dst->serial_number = read_u32_le(p + 0xA0);
-}
-
-/*
-int jmraid_get_sata_port_info(struct jmraid *jmraid, uint8_t index, struct jmraid_sata_port_info *info)
-{
-        uint8_t data_out[SECTORSIZE];
-
-        if (!jmraid_invoke_command_get_sata_port_info(jmraid, index, data_out, sizeof(data_out)))
-        {
-                return 1;
-        }
-
-        parse_jmraid_sata_port_info(data_out, info);
-
-        return 0;
-}
-*/
-
-void parse_jmraid_sata_info(const uint8_t *src, struct jmraid_sata_info *dst)
-{
-        const uint8_t *p = src;
-        int i;
-
-        memset(dst, 0, sizeof(struct jmraid_sata_info));
-
-        p += 0x04;
-        for (i = 0; i < 5; i++)
-        {
-                struct jmraid_sata_info_item *item = &dst->item[i];
-                memcpy(item->model_name, p + 0x00, 0x28);
-                swap_bytes(item->model_name, 0x28);
-                memcpy(item->serial_number, p + 0x28, 0x14);
-                swap_bytes(item->serial_number, 0x14);
-                item->capacity = ((uint64_t)read_u32_le(p + 0x3C)) * (32 * 1024 * 1024);
-                item->port_type = p[0x48];
-                item->port_speed = p[0x4A];
-                item->page_0_state = p[0x41];
-                item->page_0_raid_index = p[0x42];
-                item->page_0_raid_member_index = p[0x43];
-                item->port = p[0x49];
-                p += 0x50;
-        }
-}
-
 void print_sata_info(const struct jmraid_sata_info *info)
 {
         int i;
-        //for (i = 0; i < 5; i++)
-        for (i = 0; i < 2; i++)
+        for (i = 0; i < 5; i++)
         {
                 const struct jmraid_sata_info_item *item = &info->item[i];
                 if (i > 0)
@@ -563,28 +352,6 @@ void print_sata_info(const struct jmraid_sata_info *info)
         }
 }
 
-void parse_jmraid_sata_port_info(const uint8_t *src, struct jmraid_sata_port_info *dst)
-{
-        const uint8_t *p = src;
-
-        memset(dst, 0, sizeof(struct jmraid_sata_port_info));
-
-        p += 0x04;
-        memcpy(dst->model_name, p + 0x00, 0x28);
-        swap_bytes(dst->model_name, 0x28);
-        memcpy(dst->serial_number, p + 0x28, 0x14);
-        swap_bytes(dst->serial_number, 0x14);
-        memcpy(dst->firmware_version, p + 0x40, 0x08);
-        swap_bytes(dst->firmware_version, 0x08);
-        dst->capacity = ((uint64_t)read_u32_le(p + 0x3C)) * (32 * 1024 * 1024);
-        dst->port_type = p[0x60];
-        dst->port = p[0x5A];
-        dst->capacity_used = ((uint64_t)read_u32_le(p + 0xCC)) * (32 * 1024 * 1024);
-        dst->page_0_state = p[0xBD];
-        dst->page_0_raid_index = p[0xBE];
-        dst->page_0_raid_member_index = p[0xBF];
-}
-
 void print_sata_port_info(const struct jmraid_sata_port_info *info)
 {
         if ((info->port_type == 0x01) || (info->port_type == 0x02))
@@ -608,114 +375,102 @@ void print_sata_port_info(const struct jmraid_sata_port_info *info)
         }
 }
 
-/* SMART
-int jmraid_get_disk_smart_info(struct jmraid *jmraid, uint8_t sata_port, struct jmraid_disk_smart_info *info)
+void print_disk_smart_info(const struct jmraid_disk_smart_info *info)
 {
-        uint8_t data_in[16];
-        uint8_t data_out_1[SECTORSIZE];
-        uint8_t data_out_2[SECTORSIZE];
-
-        memset(data_in, 0, sizeof(data_in));
-        data_in[2] = 0xD0;
-        data_in[8] = 0x4F;
-        data_in[10] = 0xC2;
-        data_in[12] = 0xA0;
-        data_in[14] = 0xB0;
-
-        if (!jmraid_invoke_command_ata_passthrough(jmraid, sata_port, 0x00, 0xE0, data_in, data_out_1, sizeof(data_out_2)))
-        {
-                return 1;
-        }
-
-        memset(data_in, 0, sizeof(data_in));
-        data_in[2] = 0xD1;
-        data_in[8] = 0x4F;
-        data_in[10] = 0xC2;
-        data_in[12] = 0xA0;
-        data_in[14] = 0xB0;
-
-        if (!jmraid_invoke_command_ata_passthrough(jmraid, sata_port, 0x00, 0xE0, data_in, data_out_2, sizeof(data_out_2)))
+        int i;
+        for (i = 0; i < 30; i++)
         {
-                return 1;
+                const struct jmraid_disk_smart_info_attribute *attr = &info->attribute[i];
+                if (attr->id != 0)
+                {
+                        print("%3u | %04X | %3u | %3u | %3u | %012llX | %15llu | %s\n", attr->id, attr->flags, attr->threshold, attr->current_value, attr->worst_value, attr->raw_value, attr->raw_value, get_smart_attribute_name(attr->id));
+                }
         }
+}
 
-        parse_jmraid_disk_smart_info(data_out_1, data_out_2, info);
 
-        return 0;
+// The same as records for --format. Sizes are in bytes, codes as they are
+void emit_chip_info(struct jm_out *out, const struct jmraid_chip_info *info)
+{
+        char firmware[16];
+        snprintf(firmware, sizeof(firmware), "%02d.%02d.%02d.%02d", info->firmware_version[3], info->firmware_version[2], info->firmware_version[1], info->firmware_version[0]);
+        JM_Out_Begin(out, "chip");
+        JM_Out_Str(out, "firmware", firmware);
+        JM_Out_Str(out, "manufacturer", info->manufacturer);
+        JM_Out_Str(out, "product", info->product_name);
+        JM_Out_U64(out, "serial", info->serial_number);
+        JM_Out_End(out);
 }
 
-int jmraid_invoke_command_ata_passthrough(struct jmraid *jmraid, uint8_t sata_port, uint8_t ata_read_addr, uint8_t ata_read_size, const uint8_t *ata_data, uint8_t *data_out, uint32_t size_out)
+void emit_sata_info(struct jm_out *out, const struct jmraid_sata_info *info)
 {
-        uint8_t data_in[22];
-
-        data_in[0] = 0x02;
-        data_in[1] = 0x03;
-        data_in[2] = sata_port;
-        data_in[3] = 0x02; // ?
-        data_in[4] = ata_read_addr;
-        data_in[5] = ata_read_size;
-        memcpy(data_in + 6, ata_data, 16);
-
-        if (!jmraid_invoke_command(jmraid, data_in, sizeof(data_in), data_out, size_out))
+        int i;
+        for (i = 0; i < 5; i++)
         {
-                return 1;
+                const struct jmraid_sata_info_item *item = &info->item[i];
+                JM_Out_Begin(out, "sata");
+                JM_Out_U64(out, "port", i);
+                JM_Out_Str(out, "model", item->model_name);
+                JM_Out_Str(out, "serial", item->serial_number);
+                JM_Out_U64(out, "capacity", item->capacity);
+                JM_Out_U64(out, "type", item->port_type);
+                JM_Out_U64(out, "speed", item->port_speed);
+                JM_Out_U64(out, "state", item->page_0_state);
+                JM_Out_U64(out, "raid_index", item->page_0_raid_index);
+                JM_Out_U64(out, "member_index", item->page_0_raid_member_index);
+                JM_Out_End(out);
         }
-
-        return 0;
 }
-*/
 
-void parse_jmraid_disk_smart_info(const uint8_t *src1, const uint8_t *src2, struct jmraid_disk_smart_info *dst)
+void emit_raid_port_info(struct jm_out *out, int index, const struct jmraid_raid_port_info *info)
 {
-
-        memset(dst, 0, sizeof(struct jmraid_disk_smart_info));
-
-        if (src1)
+        int i;
+        JM_Out_Begin(out, "raid");
+        JM_Out_U64(out, "raid", index);
+        JM_Out_Str(out, "model", (const char *)info->model_name);
+        JM_Out_Str(out, "serial", (const char *)info->serial_number);
+        JM_Out_U64(out, "port_state", info->port_state);
+        JM_Out_U64(out, "level", info->level);
+        JM_Out_U64(out, "capacity", info->capacity);
+        JM_Out_U64(out, "state", info->state);
+        JM_Out_U64(out, "members", info->member_count);
+        JM_Out_U64(out, "rebuild_priority", info->rebuild_priority);
+        JM_Out_U64(out, "standby_timer", info->standby_timer);
+        JM_Out_U64(out, "rebuild_progress", info->rebuild_progress);
+        JM_Out_End(out);
+        for (i = 0; info->port_state != 0x00 && i < info->member_count && i < 5; i++)
         {
-                const uint8_t *p = src1;
-                int i;
-
-                p += 0x14;
-                p += 0x02;
-                for (i = 0; i < 30; i++)
-                {
-                        // 00h | 1 | Attribute ID Number (01h to FFh)
-                        // 01h | 2 | Status Flags 2
-                        // 03h | 1 | Attribute Value (valid values from 01h to FDh)
-                        // 04h | 8 | Vendor specific
-                        if (p[0] != 0)
-                        {
-                                struct jmraid_disk_smart_info_attribute *attribute = &dst->attribute[i];
-                                attribute->id = p[0];
-                                attribute->flags = read_u16_le(p + 1);
-                                attribute->current_value = p[3];
-                                attribute->worst_value = p[4];
-                                attribute->raw_value = read_u32_le(p + 5) | ((uint64_t)read_u16_le(p + 9) << 32);
-                        }
-                        p += 0x0C;
-                }
+                const struct jmraid_raid_port_info_member *member = &info->member[i];
+                JM_Out_Begin(out, "raid_member");
+                JM_Out_U64(out, "raid", index);
+                JM_Out_U64(out, "member", i);
+                JM_Out_U64(out, "ready", member->ready);
+                JM_Out_U64(out, "lba48", member->lba48_support);
+                JM_Out_U64(out, "sata_port", member->sata_port);
+                JM_Out_U64(out, "sata_page", member->sata_page);
+                JM_Out_U64(out, "sata_base", member->sata_base);
+                JM_Out_U64(out, "sata_size", member->sata_size);
+                JM_Out_End(out);
         }
+}
 
-        if (src2)
-        {
-                const uint8_t *p = src2;
-                int i;
-
-                p += 0x14;
-                p += 0x02;
-                for (i = 0; i < 30; i++)
-                {
-                        if (p[0] != 0)
-                        {
-                                struct jmraid_disk_smart_info_attribute *attribute = &dst->attribute[i];
-                                attribute->threshold = p[1];
-                        }
-                        p += 0x0C;
-                }
-        }
+void emit_sata_port_info(struct jm_out *out, int index, const struct jmraid_sata_port_info *info)
+{
+        JM_Out_Begin(out, "port");
+        JM_Out_U64(out, "port", index);
+        JM_Out_Str(out, "model", info->model_name);
+        JM_Out_Str(out, "serial", info->serial_number);
+        JM_Out_Str(out, "firmware", info->firmware_version);
+        JM_Out_U64(out, "capacity", info->capacity);
+        JM_Out_U64(out, "capacity_used", info->capacity_used);
+        JM_Out_U64(out, "type", info->port_type);
+        JM_Out_U64(out, "state", info->page_0_state);
+        JM_Out_U64(out, "raid_index", info->page_0_raid_index);
+        JM_Out_U64(out, "member_index", info->page_0_raid_member_index);
+        JM_Out_End(out);
 }
 
-void print_disk_smart_info(const struct jmraid_disk_smart_info *info)
+void emit_disk_smart_info(struct jm_out *out, int index, const struct jmraid_disk_smart_info *info)
 {
         int i;
         for (i = 0; i < 30; i++)
@@ -723,12 +478,20 @@ void print_disk_smart_info(const struct jmraid_disk_smart_info *info)
                 const struct jmraid_disk_smart_info_attribute *attr = &info->attribute[i];
                 if (attr->id != 0)
                 {
-                        print("%3u | %04X | %3u | %3u | %3u | %012llX | %15llu | %s\n", attr->id, attr->flags, attr->threshold, attr->current_value, attr->worst_value, attr->raw_value, attr->raw_value, get_smart_attribute_name(attr->id));
+                        JM_Out_Begin(out, "smart");
+                        JM_Out_U64(out, "disk", index);
+                        JM_Out_U64(out, "id", attr->id);
+                        JM_Out_U64(out, "flags", attr->flags);
+                        JM_Out_U64(out, "threshold", attr->threshold);
+                        JM_Out_U64(out, "value", attr->current_value);
+                        JM_Out_U64(out, "worst", attr->worst_value);
+                        JM_Out_U64(out, "raw", attr->raw_value);
+                        JM_Out_Str(out, "name", get_smart_attribute_name(attr->id));
+                        JM_Out_End(out);
                 }
         }
 }
 
-
 //Alois stop
 
 //static void GETCHIPINFO( int theFD, uint32_t scrambled_cmd, uint8_t* theCmd, uint32_t theLen) {
@@ -953,168 +716,2139 @@ void parse_and_print_sata_port_info(const uint8_t *info) {
     print_sata_port_info(&sata_port_info);
 }
 
-int main(int argc, char * argv[])
-{
-    int sg_fd, k;
-    uint8_t saveBuf[SECTORSIZE];
-    uint8_t probeBuf[SECTORSIZE];
-    uint8_t sense_buffer[32];
-    uint32_t scrambled_cmd_code;
+void parse_and_print_disk_smart_info(const uint8_t *info) {
+    // Attribute values in the first response, thresholds in the one after it
+    struct jmraid_disk_smart_info disk_smart_info;
+    parse_jmraid_disk_smart_info(info, info + SECTORSIZE, &disk_smart_info);
+    print_disk_smart_info(&disk_smart_info);
+}
 
-/*  printf("JMraidcon version x, Copyright (C) 2010 Werner Johansson\n" \
-        "JMraidcon comes with ABSOLUTELY NO WARRANTY.\n" \
-        "This is free software, and you are welcome\n" \
-        "to redistribute it under certain conditions.\n\n" );
-*/
+void parse_and_emit_jmraid_chip_info(struct jm_out *out, int index, const uint8_t *info) {
+    struct jmraid_chip_info chip_info;
+    (void)index;
+    parse_jmraid_chip_info(info, &chip_info);
+    emit_chip_info(out, &chip_info);
+}
 
-    if (3 != argc) {
-        printf("Usage : JMraidcon /dev/sd<X> <jms56x | jmb39x>\n");
-        return 1;
-    }
+void parse_and_emit_raid_port_info(struct jm_out *out, int index, const uint8_t *info) {
+    struct jmraid_raid_port_info raid_port_info;
+    parse_jmraid_raid_port_info(info, &raid_port_info);
+    emit_raid_port_info(out, index, &raid_port_info);
+}
 
-    if ((sg_fd = open(argv[1], O_RDWR)) < 0) {
-        printf("Cannot open device");
-        return 1;
+void parse_and_emit_sata_info(struct jm_out *out, int index, const uint8_t *info) {
+    struct jmraid_sata_info sata_info;
+    (void)index;
+    parse_jmraid_sata_info(info, &sata_info);
+    emit_sata_info(out, &sata_info);
+}
+
+void parse_and_emit_sata_port_info(struct jm_out *out, int index, const uint8_t *info) {
+    struct jmraid_sata_port_info sata_port_info;
+    parse_jmraid_sata_port_info(info, &sata_port_info);
+    emit_sata_port_info(out, index, &sata_port_info);
+}
+
+void parse_and_emit_disk_smart_info(struct jm_out *out, int index, const uint8_t *info) {
+    struct jmraid_disk_smart_info disk_smart_info;
+    parse_jmraid_disk_smart_info(info, info + SECTORSIZE, &disk_smart_info);
+    emit_disk_smart_info(out, index, &disk_smart_info);
+}
+
+// all values from jmraid.c + 0x10
+#define JM_RESULT_OFFSET (0x10 - 0x04)
+
+struct jm_query {
+    const char *name;
+    const char *title;          // Printed before the information, if any
+    const uint8_t *probe[2];    // SMART needs a second command for the thresholds
+    uint32_t probe_len[2];
+    void (*parse_and_print)(const uint8_t*);
+    int cached;                 // Static data answered from --cache, JM_QUERY_CACHED_*
+    int kind;                   // JM_QUERY_CONTROLLER etc., what it depends on
+    int index;                  // RAID or SATA port it is about
+    void (*parse_and_emit)(struct jm_out*, int, const uint8_t*); // --format records
+};
+
+#define JM_QUERY_CACHED            (1) // The whole response, while fresh
+#define JM_QUERY_CACHED_THRESHOLDS (2) // Only the second response, the SMART thresholds of the disk
+
+// Which queries are worth a command, going by the sata info
+#define JM_QUERY_CONTROLLER (0) // Always
+#define JM_QUERY_VOLUME     (1) // Only for a RAID port with a disk that is a member of it
+#define JM_QUERY_PORT       (2) // Only for a SATA port with a device on it
+#define JM_QUERY_DISK       (3) // Only for a SATA port with a (SMART capable) disk on it
+
+#define RAID_QUERY(n) { "raid" #n, "RAID Port " #n ":\n", { getraidportinfo_probe[n] }, { sizeof(getraidportinfo_probe[n]) }, \
+        parse_and_print_raid_port_info, 0, JM_QUERY_VOLUME, n, parse_and_emit_raid_port_info }
+#define PORT_QUERY(n) { "port" #n, "SATA Port " #n " information:\n", { getsataportinfo_probe[n] }, { sizeof(getsataportinfo_probe[n]) }, \
+        parse_and_print_sata_port_info, JM_QUERY_CACHED, JM_QUERY_PORT, n, parse_and_emit_sata_port_info }
+#define SMART_QUERY(n) { "smart" #n, "SMART Info Disk " #n ":\n", { smartread1_probe[n], smartread2_probe[n] }, \
+        { sizeof(smartread1_probe[n]), sizeof(smartread2_probe[n]) }, parse_and_print_disk_smart_info, JM_QUERY_CACHED_THRESHOLDS, JM_QUERY_DISK, n, \
+        parse_and_emit_disk_smart_info }
+
+// In the order they are printed. The sata info comes right after the chip
+// info as it tells which of the others are needed
+const struct jm_query jm_queries[] = {
+    { "chip",   NULL, { getchipinfo_probe }, { sizeof(getchipinfo_probe) }, parse_and_print_jmraid_chip_info, JM_QUERY_CACHED,
+      JM_QUERY_CONTROLLER, 0, parse_and_emit_jmraid_chip_info },
+    { "sata",   NULL, { getsatainfo_probe }, { sizeof(getsatainfo_probe) }, parse_and_print_sata_info, 0,
+      JM_QUERY_CONTROLLER, 0, parse_and_emit_sata_info },
+    RAID_QUERY(0), RAID_QUERY(1), RAID_QUERY(2), RAID_QUERY(3), RAID_QUERY(4),
+    PORT_QUERY(0), PORT_QUERY(1), PORT_QUERY(2), PORT_QUERY(3), PORT_QUERY(4),
+    SMART_QUERY(0), SMART_QUERY(1), SMART_QUERY(2), SMART_QUERY(3), SMART_QUERY(4),
+};
+#define JM_NUM_QUERIES (sizeof(jm_queries) / sizeof(jm_queries[0]))
+
+const struct jm_query *find_query(const char *name) {
+    uint32_t i;
+    // The name from when only the first RAID port was queried
+    if (strcmp(name, "raid") == 0) {
+        name = "raid0";
     }
+    for (i = 0; i < JM_NUM_QUERIES; i++) {
+        if (strcmp(jm_queries[i].name, name) == 0) {
+            return &jm_queries[i];
+        }
+    }
+    return NULL;
+}
 
-    if (strcmp(argv[2], "jms56x") == 0) {
-        printf("Using JMS56x with sector 254 (0xfe)\n\n");
-        scrambled_cmd_code = 0x197b0562;
-    } else if (strcmp(argv[2], "jmb39x") == 0) {
-        printf("Using JMB39x with sector 254 (0xfe)\n\n");
-        scrambled_cmd_code = 0x197b0322;
-    } else {
-        printf("Controller not specified");
+// Whether a query is worth a command: only RAID ports that some disk is a
+// member of, and only SATA ports with something on them. Everything is
+// without the sata info to go by
+int query_needed(const struct jm_query *query, const struct jmraid_sata_info *sata) {
+    int i;
+
+    if (!sata || query->kind == JM_QUERY_CONTROLLER) {
         return 1;
     }
-
-    // Check if the opened device looks like a sg one.
-    // Inspired by the sg_simple0 example
-    if ((ioctl(sg_fd, SG_GET_VERSION_NUM, &k) < 0) || (k < 30000)) {
-        printf("%s is not an sg device, or old sg driver\n", argv[1]);
+    if (query->kind == JM_QUERY_VOLUME) {
+        for (i = 0; i < JM_PORTS; i++) {
+            if (sata->item[i].port_type == 0x02 && sata->item[i].page_0_raid_index == query->index) {
+                return 1;
+            }
+        }
+        return 0;
+    }
+    switch (sata->item[query->index].port_type) {
+    case 0x01: // Hard Disk
+    case 0x02: // RAID Disk
         return 1;
+    case 0x03: // Optical Drive, no SMART
+        return query->kind == JM_QUERY_PORT;
+    default:   // No Device, Bad Port, Skip, Off, Host
+        return 0;
     }
+}
 
-    // Setup the ioctl struct
-    memset(&io_hdr, 0, sizeof(sg_io_hdr_t));
-    io_hdr.interface_id = 'S';
-    io_hdr.cmd_len = sizeof(rwCmdBlk);
-    io_hdr.mx_sb_len = sizeof(sense_buffer);
-    io_hdr.dxfer_direction = SG_DXFER_FROM_DEV;
-    io_hdr.dxfer_len = SECTORSIZE;
-    io_hdr.dxferp = saveBuf;
-    io_hdr.cmdp = rwCmdBlk;
-    io_hdr.sbp = sense_buffer;
-    io_hdr.timeout = 3000;
-
-    // Add more error handling like this later
-    if( ioctl( sg_fd, SG_IO, &io_hdr ) < 0 ) {
-        printf("ioctl SG_IO failed");
-        return 1;
+uint32_t run_query_probes(struct jmraid *jmraid, const struct jm_query *query, uint32_t probes, uint8_t *resultBuf);
+
+// Send the commands of a query, one response sector per command in resultBuf.
+// Returns the worst send_cmd() result
+uint32_t run_query(struct jmraid *jmraid, const struct jm_query *query, uint8_t *resultBuf) {
+    return run_query_probes(jmraid, query, 3, resultBuf);
+}
+
+// The same for only some of the commands, bit i of probes for probe[i]
+uint32_t run_query_probes(struct jmraid *jmraid, const struct jm_query *query, uint32_t probes, uint8_t *resultBuf) {
+    uint32_t retval = JM_CMD_OK;
+    int i;
+    // Reading the disks goes through the controller to the disks behind
+    // it, that is the I/O a budget is there to hold back first
+    jmraid_set_priority(jmraid, query->kind == JM_QUERY_DISK ? JMRAID_PRIO_LOW : JMRAID_PRIO_NORMAL);
+    for (i = 0; i < 2 && query->probe[i]; i++) {
+        uint32_t res;
+        if (!(probes & (1 << i))) {
+            continue;
+        }
+        res = jmraid_send_command(jmraid, query->probe[i], query->probe_len[i], resultBuf + i * SECTORSIZE);
+        if (res > retval) {
+            retval = res;
+        }
     }
+    jmraid_set_priority(jmraid, JMRAID_PRIO_NORMAL);
+    return retval;
+}
 
-    // Generate and send the initial "wakeup" data
-    // No idea what the second dword represents at this point
-    // Note that these (and all other writes) should be directed to an unused sector!!
-    memset( probeBuf, 0, SECTORSIZE );
+// A query or a controller that did not answer, as an "error" record with
+// --format, instead of the text the caller prints. query may be NULL
+static void emit_error(const char *device, const char *query, const char *message) {
+    JM_Out_Begin(&g_out, "error");
+    JM_Out_Str(&g_out, "device", device ? device : "");
+    JM_Out_Str(&g_out, "query", query ? query : "");
+    JM_Out_Str(&g_out, "message", message);
+    JM_Out_End(&g_out);
+}
 
-    // For wide access
-    uint32_t* probeBuf32 = (uint32_t*)probeBuf;
+// How long a query waited for the I/O budget of --budget, if at all
+static void report_budget(struct jmraid *jmraid, const struct jm_query *query) {
+    uint64_t waited = jmraid_budget_waited(jmraid);
 
-    // Populate with the static data
-    probeBuf32[0 >> 2] = __cpu_to_le32( JM_RAID_WAKEUP_CMD );
-    probeBuf32[0x1f8 >> 2] = __cpu_to_le32( 0x10eca1db );
-    for( uint32_t i=0x10; i<0x1f8; i++ ) {
-        probeBuf[i] = i&0xff;
+    if (!waited) {
+        return;
     }
+    if (g_format >= 0) {
+        JM_Out_Begin(&g_out, "budget");
+        JM_Out_Str(&g_out, "query", query->name);
+        JM_Out_U64(&g_out, "wait_us", waited);
+        JM_Out_End(&g_out);
+    } else {
+        print("%s waited %llu.%03llu ms for the I/O budget\n", query->name,
+              (unsigned long long)waited / 1000, (unsigned long long)waited % 1000);
+    }
+}
 
-    io_hdr.dxfer_direction = SG_DXFER_TO_DEV;
-    rwCmdBlk[0] = WRITE_CMD;
-    io_hdr.dxferp = probeBuf;
+void print_query(const struct jm_query *query, const uint8_t *resultBuf) {
+    if (query->title) {
+        print(query->title);
+    }
+    query->parse_and_print(resultBuf + JM_RESULT_OFFSET);
+    print("\n");
+}
 
-    // The only value (except the CRC at the end) that changes between the 4 wakeup sectors
-    probeBuf32[4 >> 2] = __cpu_to_le32( 0x3c75a80b );
-    uint32_t myCRC = JM_CRC( probeBuf32, 0x1fc >> 2 );
-    probeBuf32[0x1fc >> 2] = __cpu_to_le32( myCRC );
-    ioctl(sg_fd, SG_IO, &io_hdr);
+// The same, or its records with --format
+void output_query(const struct jm_query *query, const uint8_t *resultBuf) {
+    if (g_format < 0) {
+        print_query(query, resultBuf);
+        return;
+    }
+    query->parse_and_emit(&g_out, query->index, resultBuf + JM_RESULT_OFFSET);
+}
 
-    probeBuf32[4 >> 2] = __cpu_to_le32( 0x0388e337 );
-    myCRC = JM_CRC( probeBuf32, 0x1fc >> 2 );
-    probeBuf32[0x1fc >> 2] = __cpu_to_le32( myCRC );
-    ioctl(sg_fd, SG_IO, &io_hdr);
+// Fingerprint of all responses to a query, to notice that nothing changed
+// without decoding anything. resultBuf must be dword aligned
+uint32_t query_fingerprint(const struct jm_query *query, const uint8_t *resultBuf) {
+    uint32_t fingerprint = JM_CRC_INIT;
+    int i;
+    for (i = 0; i < 2 && query->probe[i]; i++) {
+        fingerprint = JM_Cmd_Fingerprint(fingerprint, (const uint32_t *)(resultBuf + i * SECTORSIZE));
+    }
+    return fingerprint;
+}
 
-    probeBuf32[4 >> 2] = __cpu_to_le32( 0x689705f3 );
-    myCRC = JM_CRC( probeBuf32, 0x1fc >> 2 );
-    probeBuf32[0x1fc >> 2] = __cpu_to_le32( myCRC );
-    ioctl(sg_fd, SG_IO, &io_hdr);
+// Change detection for the one-shot mode, the state of the last run is kept
+// in a jm_cache file: the fingerprint as key and the responses, so --diff
+// can tell what changed. SMART's second response goes in as "<name>+"
+static int query_unchanged(const struct jm_cache *state, const struct jm_query *query, uint32_t fingerprint) {
+    const struct jm_cache_entry *entry = JM_Cache_Find(state, query->name);
+    char key[JM_CACHE_KEY];
+    snprintf(key, sizeof(key), "%08x", fingerprint);
+    return entry && strcmp(entry->key, key) == 0;
+}
 
-    probeBuf32[4 >> 2] = __cpu_to_le32( 0xe00c523a );
-    myCRC = JM_CRC( probeBuf32, 0x1fc >> 2 );
-    probeBuf32[0x1fc >> 2] = __cpu_to_le32( myCRC );
-    ioctl(sg_fd, SG_IO, &io_hdr);
+static void store_query(struct jm_cache *state, const struct jm_query *query, uint32_t fingerprint, const uint8_t *resultBuf) {
+    char key[JM_CACHE_KEY];
+    char name[16];
+    snprintf(key, sizeof(key), "%08x", fingerprint);
+    JM_Cache_Put(state, query->name, key, resultBuf);
+    if (query->probe[1]) {
+        snprintf(name, sizeof(name), "%s+", query->name);
+        JM_Cache_Put(state, name, key, resultBuf + SECTORSIZE);
+    }
+}
 
-    // Initial probe complete, now send scrambled commands to the same sector
+// The output of print_query() as text, NULL if out of memory
+static char *render_query(const struct jm_query *query, const uint8_t *resultBuf) {
+    char *text = NULL;
+    size_t size;
+    FILE *out = open_memstream(&text, &size);
 
+    if (!out) {
+        return NULL;
+    }
+    g_print_file = out;
+    print_query(query, resultBuf);
+    g_print_file = NULL;
+    fclose(out);
+    return text;
+}
 
-    //Get Chip Info
-    process_cmd(sg_fd, scrambled_cmd_code, (uint8_t*)getchipinfo_probe, sizeof(getchipinfo_probe), 0xC, parse_and_print_jmraid_chip_info);
-    print("\n");
+// Print only the lines (fields) of a query whose value differs from the last
+// run. A query's output has a fixed layout, so comparing line by line lines
+// the fields up. Returns -1 if there is nothing to compare with
+static int print_query_diff(const struct jm_cache *state, const struct jm_query *query, const uint8_t *resultBuf) {
+    uint8_t previous[2*SECTORSIZE];
+    const struct jm_cache_entry *entry;
+    char name[16];
+    char *old_text, *new_text;
+    char *old_line, *new_line, *old_next, *new_next;
+    char *header = NULL;        // Last unindented line, printed once before an indented field below it
+    size_t header_len = 0;
+
+    if (!(entry = JM_Cache_Find(state, query->name))) {
+        return -1;
+    }
+    memcpy(previous, entry->response, SECTORSIZE);
+    if (query->probe[1]) {
+        snprintf(name, sizeof(name), "%s+", query->name);
+        if (!(entry = JM_Cache_Find(state, name))) {
+            return -1;
+        }
+        memcpy(previous + SECTORSIZE, entry->response, SECTORSIZE);
+    }
 
-/*
-    //Get Raid Port Info
-    const uint8_t *info2 = SENDCMD( sg_fd, scrambled_cmd_code, (uint8_t*)getraidportinfo_probe, sizeof(getraidportinfo_probe) );
-    struct jmraid_raid_port_info raid_port_info;
-    parse_jmraid_raid_port_info(info2, &raid_port_info);
-    print_raid_port_info(&raid_port_info);
-    print("\n");
+    old_text = render_query(query, previous);
+    new_text = render_query(query, resultBuf);
+    if (!old_text || !new_text) {
+        free(old_text);
+        free(new_text);
+        return -1;
+    }
 
-    GETCHIPINFO( sg_fd, scrambled_cmd_code, (uint8_t*)getchipinfo_probe, sizeof(getchipinfo_probe) );
-    print("\n");
-*/
+    print("%s changed:\n", query->name);
+    for (old_line = old_text, new_line = new_text; *new_line; new_line = new_next) {
+        size_t len;
 
-    process_cmd(sg_fd, scrambled_cmd_code, (uint8_t*)getraidportinfo_probe, sizeof(getraidportinfo_probe), 0x10-0x04, parse_and_print_raid_port_info);
-    print("\n");
+        new_next = strchr(new_line, '\n');
+        new_next = new_next ? new_next + 1 : new_line + strlen(new_line);
+        len = new_next - new_line;
 
-    process_cmd(sg_fd, scrambled_cmd_code, (uint8_t*)getsatainfo_probe, sizeof(getsatainfo_probe), 0x10-0x04, parse_and_print_sata_info);
-    print("\n");
-    print("SATA Port 0 information:\n");
-    process_cmd(sg_fd, scrambled_cmd_code, (uint8_t*)getsataport0info_probe, sizeof(getsataport0info_probe), 0x10-0x04, parse_and_print_sata_port_info);
-    print("\n");
-    print("SATA Port 1 information:\n");
-    process_cmd(sg_fd, scrambled_cmd_code, (uint8_t*)getsataport1info_probe, sizeof(getsataport1info_probe), 0x10-0x04, parse_and_print_sata_port_info);
-    print("\n");
+        old_next = strchr(old_line, '\n');
+        old_next = old_next ? old_next + 1 : old_line + strlen(old_line);
+        if (new_line[0] != ' ') {
+            header = new_line;
+            header_len = len;
+        }
+        if ((size_t)(old_next - old_line) != len || memcmp(old_line, new_line, len) != 0) {
+            if (header && header != new_line) {
+                JM_Out_Printf(&g_out, "%.*s", (int)header_len, header);
+            }
+            header = NULL;
+            JM_Out_Printf(&g_out, "%.*s", (int)len, new_line);
+        }
+        old_line = old_next;
+    }
+    free(old_text);
+    free(new_text);
+    return 0;
+}
 
-    /* work in progress by Elmar (2022-12-10) */
-    const uint8_t *resultBuf1 = malloc(SECTORSIZE);
-    const uint8_t *resultBuf2 = malloc(SECTORSIZE);
-    {
-        print("SMART Info Disk 0:\n");
-        send_cmd(sg_fd, scrambled_cmd_code, (uint8_t*)disk0smartread1_probe, sizeof(disk0smartread1_probe), resultBuf1);
-        send_cmd(sg_fd, scrambled_cmd_code, (uint8_t*)disk0smartread2_probe, sizeof(disk0smartread2_probe), resultBuf2);
-        struct jmraid_disk_smart_info disk_smart_info;
-        parse_jmraid_disk_smart_info(resultBuf1+0x10-0x04, resultBuf2+0x10-0x04, &disk_smart_info);
-        print_disk_smart_info(&disk_smart_info);
-        print("\n");
+// What a cached response belongs to. The chip info only expires, the disk
+// identities belong to the controller and to the disk the sata query just
+// reported on that port, so a swapped disk (or controller) is asked again.
+// SMART thresholds belong to the disk alone, by model and serial.
+// Returns -1 if there is nothing to key it on
+static int cache_key(const struct jm_query *query, const struct jmraid_chip_info *chip,
+                     const struct jmraid_sata_info *sata, char *key, size_t size) {
+    int port;
+
+    if (strcmp(query->name, "chip") == 0) {
+        key[0] = 0;
+        return 0;
     }
-    {
-        print("SMART Info Disk 1:\n");
-        send_cmd(sg_fd, scrambled_cmd_code, (uint8_t*)disk1smartread1_probe, sizeof(disk1smartread1_probe), resultBuf1);
-        send_cmd(sg_fd, scrambled_cmd_code, (uint8_t*)disk1smartread2_probe, sizeof(disk1smartread2_probe), resultBuf2);
-        struct jmraid_disk_smart_info disk_smart_info;
-        parse_jmraid_disk_smart_info(resultBuf1+0x10-0x04, resultBuf2+0x10-0x04, &disk_smart_info);
-        print_disk_smart_info(&disk_smart_info);
-        print("\n");
+    if (sata && sscanf(query->name, "smart%d", &port) == 1 && port >= 0 && port < 5) {
+        if (sata->item[port].port_type != 0x01 && sata->item[port].port_type != 0x02) {
+            return -1;
+        }
+        snprintf(key, size, "%s/%s", sata->item[port].model_name, sata->item[port].serial_number);
+        return 0;
+    }
+    if (!chip || !sata || sscanf(query->name, "port%d", &port) != 1 || port < 0 || port >= 5) {
+        return -1;
+    }
+    snprintf(key, size, "%u/%s", chip->serial_number,
+             (sata->item[port].port_type == 0x01 || sata->item[port].port_type == 0x02) ? sata->item[port].serial_number : "-");
+    return 0;
+}
+
+// Run a query, or take its response from the cache. Fresh responses go into
+// the cache and set *dirty
+static uint32_t run_query_cached(struct jmraid *jmraid, struct jm_cache *cache, uint32_t ttl, const struct jm_query *query,
+                                 const char *key, uint8_t *resultBuf, int *dirty) {
+    const uint8_t *response;
+    uint32_t res;
+
+    if (query->cached == JM_QUERY_CACHED_THRESHOLDS) {
+        char name[16];
+
+        // Vendor constants for the life of the disk, only a ttl of 0 reads
+        // them again. The values still come from the disk every time
+        snprintf(name, sizeof(name), "%s+", query->name);
+        if ((response = JM_Cache_Get(cache, name, key, ttl ? UINT32_MAX : 0))) {
+            memcpy(resultBuf + SECTORSIZE, response, SECTORSIZE);
+            return run_query_probes(jmraid, query, 1, resultBuf);
+        }
+        res = run_query(jmraid, query, resultBuf);
+        if (res == JM_CMD_OK) {
+            JM_Cache_Put(cache, name, key, resultBuf + SECTORSIZE);
+            *dirty = 1;
+        }
+        return res;
     }
-    free(resultBuf1);
-    free(resultBuf2);
 
+    response = JM_Cache_Get(cache, query->name, key, ttl);
+    if (response) {
+        memcpy(resultBuf, response, SECTORSIZE);
+        return JM_CMD_OK;
+    }
+    res = run_query(jmraid, query, resultBuf);
+    if (res == JM_CMD_OK) {
+        JM_Cache_Put(cache, query->name, key, resultBuf);
+        *dirty = 1;
+    }
+    return res;
+}
 
-    // Restore the original data to the sector
-    io_hdr.dxfer_direction = SG_DXFER_TO_DEV;
-    rwCmdBlk[0] = WRITE_CMD;
-    io_hdr.dxferp = saveBuf;
-    ioctl(sg_fd, SG_IO, &io_hdr);
+// --standby: SMART of a disk the controller spun down is not read, as that
+// would spin it up again. CHECK POWER MODE does not. Only a disk known to
+// be in standby counts, one that does not answer is read as before
+static int disk_in_standby(struct jmraid *jmraid, int port) {
+    static int warned;
+    uint8_t mode;
+    int res;
+
+    // A disk command like the SMART read it may save
+    jmraid_set_priority(jmraid, JMRAID_PRIO_LOW);
+    res = jmraid_get_disk_power_mode(jmraid, port, &mode);
+    jmraid_set_priority(jmraid, JMRAID_PRIO_NORMAL);
+    if (res) {
+        return 0;
+    }
+    // Better to wake it than to never read SMART again
+    if (mode == JMRAID_POWER_UNKNOWN && !warned) {
+        fprintf(stderr, "Warning: the controller does not return the power mode, --standby has no effect\n");
+        warned = 1;
+    }
+    return mode == JMRAID_POWER_STANDBY;
+}
 
-    close(sg_fd);
-    return 0;
+// In its place, what --cache has from the last time the disk was awake
+static void print_standby_query(const struct jm_cache *cache, const struct jm_query *query, const char *key) {
+    uint8_t resultBuf[2*SECTORSIZE] __attribute__((aligned(4)));
+    const struct jm_cache_entry *values = NULL, *thresholds = NULL;
+    char name[16];
+
+    if (cache && key) {
+        snprintf(name, sizeof(name), "%s+", query->name);
+        values = JM_Cache_Find(cache, query->name);
+        thresholds = JM_Cache_Find(cache, name);
+    }
+    // Both, and of this very disk. The file may have been edited or damaged
+    if (values && (!thresholds || strcmp(values->key, key) != 0 || strcmp(thresholds->key, key) != 0)) {
+        values = thresholds = NULL;
+    }
+    if (g_format >= 0) {
+        JM_Out_Begin(&g_out, "standby");
+        JM_Out_U64(&g_out, "disk", query->index);
+        JM_Out_U64(&g_out, "read", values ? values->stored : 0);
+        JM_Out_End(&g_out);
+    } else {
+        print(query->title);
+        if (!values) {
+            print("Disk in standby, not read\n\n");
+            return;
+        }
+        print("Disk in standby, as read %llu s ago\n", (unsigned long long)(time(NULL) - values->stored));
+    }
+    if (values) {
+        memcpy(resultBuf, values->response, SECTORSIZE);
+        memcpy(resultBuf + SECTORSIZE, thresholds->response, SECTORSIZE);
+        if (g_format >= 0) {
+            query->parse_and_emit(&g_out, query->index, resultBuf + JM_RESULT_OFFSET);
+        } else {
+            query->parse_and_print(resultBuf + JM_RESULT_OFFSET);
+            print("\n");
+        }
+    }
+}
+
+// --fields: single values instead of everything, where each field only
+// costs the commands of the query it comes from
+enum {
+    JM_FIELD_STR,
+    JM_FIELD_U8,
+    JM_FIELD_U16,
+    JM_FIELD_U32,
+    JM_FIELD_GB,                // uint64_t bytes
+    JM_FIELD_FIRMWARE,          // uint8_t[4], printed as the chip info does
+    JM_FIELD_PROGRESS,          // Rebuild progress of the RAID port, in %
+};
+
+struct jm_field {
+    const char *group;          // "chip", "raid", "sata" or "port", all but the chip indexed
+    const char *name;
+    size_t offset;              // In the decoded struct of the group
+    int type;
+    const char *(*text)(uint8_t); // Meaning of a JM_FIELD_U8 value, if any
+};
+
+#define JM_FIELD(group, name, type, member, kind, text) { group, name, offsetof(type, member), kind, text }
+
+static const struct jm_field jm_fields[] = {
+    JM_FIELD("chip", "firmware",         struct jmraid_chip_info, firmware_version, JM_FIELD_FIRMWARE, NULL),
+    JM_FIELD("chip", "manufacturer",     struct jmraid_chip_info, manufacturer, JM_FIELD_STR, NULL),
+    JM_FIELD("chip", "product",          struct jmraid_chip_info, product_name, JM_FIELD_STR, NULL),
+    JM_FIELD("chip", "serial",           struct jmraid_chip_info, serial_number, JM_FIELD_U32, NULL),
+    JM_FIELD("raid", "model",            struct jmraid_raid_port_info, model_name, JM_FIELD_STR, NULL),
+    JM_FIELD("raid", "serial",           struct jmraid_raid_port_info, serial_number, JM_FIELD_STR, NULL),
+    JM_FIELD("raid", "port_state",       struct jmraid_raid_port_info, port_state, JM_FIELD_U8, NULL),
+    JM_FIELD("raid", "level",            struct jmraid_raid_port_info, level, JM_FIELD_U8, get_raid_level_text),
+    JM_FIELD("raid", "capacity",         struct jmraid_raid_port_info, capacity, JM_FIELD_GB, NULL),
+    JM_FIELD("raid", "state",            struct jmraid_raid_port_info, state, JM_FIELD_U8, get_raid_state_text),
+    JM_FIELD("raid", "members",          struct jmraid_raid_port_info, member_count, JM_FIELD_U8, NULL),
+    JM_FIELD("raid", "rebuild_priority", struct jmraid_raid_port_info, rebuild_priority, JM_FIELD_U16, NULL),
+    JM_FIELD("raid", "standby_timer",    struct jmraid_raid_port_info, standby_timer, JM_FIELD_U16, NULL),
+    JM_FIELD("raid", "rebuild_progress", struct jmraid_raid_port_info, rebuild_progress, JM_FIELD_PROGRESS, NULL),
+    JM_FIELD("sata", "model",            struct jmraid_sata_info_item, model_name, JM_FIELD_STR, NULL),
+    JM_FIELD("sata", "serial",           struct jmraid_sata_info_item, serial_number, JM_FIELD_STR, NULL),
+    JM_FIELD("sata", "capacity",         struct jmraid_sata_info_item, capacity, JM_FIELD_GB, NULL),
+    JM_FIELD("sata", "type",             struct jmraid_sata_info_item, port_type, JM_FIELD_U8, get_sata_port_type_text),
+    JM_FIELD("sata", "speed",            struct jmraid_sata_info_item, port_speed, JM_FIELD_U8, get_sata_port_speed_text),
+    JM_FIELD("sata", "state",            struct jmraid_sata_info_item, page_0_state, JM_FIELD_U8, get_sata_page_state_text),
+    JM_FIELD("port", "model",            struct jmraid_sata_port_info, model_name, JM_FIELD_STR, NULL),
+    JM_FIELD("port", "serial",           struct jmraid_sata_port_info, serial_number, JM_FIELD_STR, NULL),
+    JM_FIELD("port", "firmware",         struct jmraid_sata_port_info, firmware_version, JM_FIELD_STR, NULL),
+    JM_FIELD("port", "capacity",         struct jmraid_sata_port_info, capacity, JM_FIELD_GB, NULL),
+    JM_FIELD("port", "capacity_used",    struct jmraid_sata_port_info, capacity_used, JM_FIELD_GB, NULL),
+    JM_FIELD("port", "type",             struct jmraid_sata_port_info, port_type, JM_FIELD_U8, get_sata_port_type_text),
+};
+#define JM_NUM_FIELDS (sizeof(jm_fields) / sizeof(jm_fields[0]))
+
+#define JM_FIELDS_MAX  (128)
+
+// SMART attribute parts, disk[N].smart.<id>[.<part>]
+enum { JM_SMART_RAW, JM_SMART_VALUE, JM_SMART_WORST, JM_SMART_THRESHOLD };
+
+// One requested field, with [*] expanded
+struct jm_field_ref {
+    char name[64];              // As printed
+    const struct jm_field *field; // NULL for a SMART attribute
+    const struct jm_query *query;
+    uint32_t probes;            // Commands of the query it needs
+    int index;                  // Port or disk
+    int wildcard;               // From [*], left out if the port or volume is not in use
+    int smart_id;
+    int smart_part;
+};
+
+// Everything the planned queries decode into
+struct jm_field_values {
+    uint32_t valid;             // Bit n set if query n answered
+    uint32_t unused;            // Bit n set if query n was not needed for [*]
+    struct jmraid_chip_info chip;
+    struct jmraid_raid_port_info raid[JM_PORTS];
+    struct jmraid_sata_info sata;
+    struct jmraid_sata_port_info port[JM_PORTS];
+    struct jmraid_disk_smart_info smart[JM_PORTS];
+};
+
+static const struct jm_query *field_query(const char *group, int index) {
+    char name[16];
+    if (strcmp(group, "disk") == 0) {
+        // disk[N] is SMART, the rest about a disk is port[N]
+        snprintf(name, sizeof(name), "smart%d", index);
+    } else if (strcmp(group, "port") == 0 || strcmp(group, "raid") == 0) {
+        snprintf(name, sizeof(name), "%s%d", group, index);
+    } else {
+        snprintf(name, sizeof(name), "%s", group);
+    }
+    return find_query(name);
+}
+
+// Parse one selector such as raid.state, port[1].serial or disk[*].smart.194,
+// adding a reference per port it stands for. raid without an index is the
+// first RAID port. Returns -1 if it is not a field
+static int parse_field(const char *spec, struct jm_field_ref *refs, int *count) {
+    char group[8], rest[32];
+    int first = -1, last = -1, indexed, wildcard = 0, index, len = 0;
+    uint32_t i;
+
+    if (sscanf(spec, "%7[a-z][*]%n", group, &len) == 1 && len) {
+        first = 0;
+        last = JM_PORTS - 1;
+        wildcard = 1;
+    } else if (len = 0, sscanf(spec, "%7[a-z][%d]%n", group, &index, &len) == 2 && len) {
+        if (index < 0 || index >= JM_PORTS) {
+            return -1;
+        }
+        first = last = index;
+    } else if (sscanf(spec, "%7[a-z]%n", group, &len) != 1) {
+        return -1;
+    }
+    if (spec[len] != '.' || snprintf(rest, sizeof(rest), "%s", spec + len + 1) >= (int)sizeof(rest)) {
+        return -1;
+    }
+    // The chip has no index, the others need one (but raid defaults to 0)
+    indexed = first >= 0;
+    if ((strcmp(group, "chip") == 0 && indexed) ||
+        (strcmp(group, "chip") != 0 && strcmp(group, "raid") != 0 && !indexed)) {
+        return -1;
+    }
+    if (!indexed) {
+        first = last = 0;
+    }
+
+    for (index = first; index <= last; index++) {
+        struct jm_field_ref ref;
+
+        memset(&ref, 0, sizeof(ref));
+        ref.index = index;
+        ref.wildcard = wildcard;
+        if (indexed) {
+            snprintf(ref.name, sizeof(ref.name), "%s[%d].%s", group, index, rest);
+        } else {
+            snprintf(ref.name, sizeof(ref.name), "%s.%s", group, rest);
+        }
+        if (strcmp(group, "disk") == 0) {
+            char part[16] = "";
+            if (sscanf(rest, "smart.%d.%15s", &ref.smart_id, part) < 1 || ref.smart_id < 1 || ref.smart_id > 255) {
+                return -1;
+            }
+            if (!part[0]) {
+                ref.smart_part = JM_SMART_RAW;
+            } else if (strcmp(part, "value") == 0) {
+                ref.smart_part = JM_SMART_VALUE;
+            } else if (strcmp(part, "worst") == 0) {
+                ref.smart_part = JM_SMART_WORST;
+            } else if (strcmp(part, "threshold") == 0) {
+                ref.smart_part = JM_SMART_THRESHOLD;
+            } else {
+                return -1;
+            }
+            // The thresholds are a second command, only sent if asked for
+            ref.probes = ref.smart_part == JM_SMART_THRESHOLD ? 3 : 1;
+        } else {
+            for (i = 0; i < JM_NUM_FIELDS; i++) {
+                if (strcmp(jm_fields[i].group, group) == 0 && strcmp(jm_fields[i].name, rest) == 0) {
+                    ref.field = &jm_fields[i];
+                    break;
+                }
+            }
+            if (!ref.field) {
+                return -1;
+            }
+            ref.probes = 1;
+        }
+        if (!(ref.query = field_query(group, index)) || *count >= JM_FIELDS_MAX) {
+            return -1;
+        }
+        refs[(*count)++] = ref;
+    }
+    return 0;
+}
+
+// One field as "name = value", or a "field" record with the value as in the
+// other records (bytes, codes), a string where it is one. valid 0 and an
+// empty value if the query failed
+static void output_field(const struct jm_field_ref *ref, int valid, int is_num, uint64_t num, const char *text) {
+    if (g_format < 0) {
+        print("%s = %s\n", ref->name, valid ? text : "?");
+        return;
+    }
+    JM_Out_Begin(&g_out, "field");
+    JM_Out_Str(&g_out, "name", ref->name);
+    JM_Out_U64(&g_out, "valid", valid);
+    if (valid && is_num) {
+        JM_Out_U64(&g_out, "value", num);
+    } else {
+        JM_Out_Str(&g_out, "value", valid ? text : "");
+    }
+    JM_Out_End(&g_out);
+}
+
+static void print_field_ref(const struct jm_field_ref *ref, const struct jm_field_values *values) {
+    const struct jm_field *field = ref->field;
+    const uint8_t *base;
+    char text[96];
+    uint64_t num = 0;
+    int is_num = 1;
+
+    if (values->unused & (1 << (ref->query - jm_queries))) {
+        return;
+    }
+    if (!(values->valid & (1 << (ref->query - jm_queries)))) {
+        output_field(ref, 0, 0, 0, NULL);
+        return;
+    }
+
+    if (!field) {
+        const struct jmraid_disk_smart_info *smart = &values->smart[ref->index];
+        int i;
+        for (i = 0; i < 30 && smart->attribute[i].id != ref->smart_id; i++)
+            ;
+        if (i == 30) {
+            output_field(ref, 0, 0, 0, NULL);
+            return;
+        } else if (ref->smart_part == JM_SMART_VALUE) {
+            num = smart->attribute[i].current_value;
+        } else if (ref->smart_part == JM_SMART_WORST) {
+            num = smart->attribute[i].worst_value;
+        } else if (ref->smart_part == JM_SMART_THRESHOLD) {
+            num = smart->attribute[i].threshold;
+        } else {
+            num = smart->attribute[i].raw_value;
+        }
+        snprintf(text, sizeof(text), "%llu", (unsigned long long)num);
+        output_field(ref, 1, 1, num, text);
+        return;
+    }
+
+    if (strcmp(field->group, "chip") == 0) {
+        base = (const uint8_t *)&values->chip;
+    } else if (strcmp(field->group, "raid") == 0) {
+        base = (const uint8_t *)&values->raid[ref->index];
+    } else if (strcmp(field->group, "sata") == 0) {
+        base = (const uint8_t *)&values->sata.item[ref->index];
+    } else {
+        base = (const uint8_t *)&values->port[ref->index];
+    }
+    base += field->offset;
+
+    switch (field->type) {
+    case JM_FIELD_STR:
+        snprintf(text, sizeof(text), "%s", (const char *)base);
+        is_num = 0;
+        break;
+    case JM_FIELD_U8:
+        num = *base;
+        if (field->text) {
+            snprintf(text, sizeof(text), "%u (%s)", *base, field->text(*base));
+        } else {
+            snprintf(text, sizeof(text), "%u", *base);
+        }
+        break;
+    case JM_FIELD_U16:
+        num = *(const uint16_t *)base;
+        snprintf(text, sizeof(text), "%u", *(const uint16_t *)base);
+        break;
+    case JM_FIELD_U32:
+        num = *(const uint32_t *)base;
+        snprintf(text, sizeof(text), "%u", *(const uint32_t *)base);
+        break;
+    case JM_FIELD_GB:
+        num = *(const uint64_t *)base;
+        snprintf(text, sizeof(text), "%.2f GB", (float)*(const uint64_t *)base / (1 * 1024 * 1024 * 1024));
+        break;
+    case JM_FIELD_FIRMWARE:
+        snprintf(text, sizeof(text), "%02d.%02d.%02d.%02d", base[3], base[2], base[1], base[0]);
+        is_num = 0;
+        break;
+    case JM_FIELD_PROGRESS:
+        // As rebuild_progress of the raid record, out of the capacity
+        num = values->raid[ref->index].rebuild_progress;
+        snprintf(text, sizeof(text), "%.2f %%", values->raid[ref->index].capacity ?
+                 (float)values->raid[ref->index].rebuild_progress * 100 / values->raid[ref->index].capacity : 0);
+        break;
+    }
+    output_field(ref, 1, is_num, num, text);
+}
+
+static struct jm_field_ref field_refs[JM_FIELDS_MAX];
+static int field_count;
+
+// Parse a comma separated list of fields, before touching the device.
+// Returns -1 if a field is not known
+static int parse_fields(const char *list) {
+    struct jm_field_ref *refs = field_refs;
+    int *count = &field_count;
+    char spec[64];
+    const char *p = list;
+
+    while (*p) {
+        size_t len = strcspn(p, ",");
+        if (len == 0 || len >= sizeof(spec)) {
+            printf("Unknown field %.*s\n", (int)len, p);
+            return -1;
+        }
+        memcpy(spec, p, len);
+        spec[len] = 0;
+        if (parse_field(spec, refs, count) < 0) {
+            printf("Unknown field %s\n", spec);
+            return -1;
+        }
+        p += len;
+        if (*p == ',') {
+            p++;
+        }
+    }
+    return 0;
+}
+
+// Plan and run the queries behind the parsed fields: each query once, with
+// only the commands the fields need, then print the fields in the order
+// asked for. What [*] stands for comes from the sata info, so [*] only
+// covers the ports and volumes in use
+static void run_fields(struct jmraid *jmraid) {
+    const struct jm_field_ref *refs = field_refs;
+    static struct jm_field_values values;
+    uint32_t probes[JM_NUM_QUERIES];
+    uint32_t named = 0;         // Bit n set if query n was asked for by index
+    uint8_t resultBuf[2*SECTORSIZE] __attribute__((aligned(4)));
+    int count = field_count, i;
+    uint32_t n, sata = find_query("sata") - jm_queries;
+
+    memset(probes, 0, sizeof(probes));
+    for (i = 0; i < count; i++) {
+        n = refs[i].query - jm_queries;
+        probes[n] |= refs[i].probes;
+        if (!refs[i].wildcard) {
+            named |= 1 << n;
+        } else if (refs[i].query->kind != JM_QUERY_CONTROLLER) {
+            probes[sata] |= 1;
+        }
+    }
+
+    memset(&values, 0, sizeof(values));
+    for (n = 0; n < JM_NUM_QUERIES; n++) {
+        const struct jm_query *query = &jm_queries[n];
+        const uint8_t *info = resultBuf + JM_RESULT_OFFSET;
+        int port;
+
+        if (!probes[n]) {
+            continue;
+        }
+        if (!(named & (1 << n)) && !query_needed(query, (values.valid & (1 << sata)) ? &values.sata : NULL)) {
+            values.unused |= 1 << n;
+            continue;
+        }
+        if (run_query_probes(jmraid, query, probes[n], resultBuf) != JM_CMD_OK) {
+            continue;
+        }
+        values.valid |= 1 << n;
+        if (strcmp(query->name, "chip") == 0) {
+            parse_jmraid_chip_info(info, &values.chip);
+        } else if (sscanf(query->name, "raid%d", &port) == 1) {
+            parse_jmraid_raid_port_info(info, &values.raid[port]);
+        } else if (strcmp(query->name, "sata") == 0) {
+            parse_jmraid_sata_info(info, &values.sata);
+        } else if (sscanf(query->name, "port%d", &port) == 1) {
+            parse_jmraid_sata_port_info(info, &values.port[port]);
+        } else if (sscanf(query->name, "smart%d", &port) == 1) {
+            parse_jmraid_disk_smart_info(info, (probes[n] & 2) ? info + SECTORSIZE : NULL, &values.smart[port]);
+        }
+    }
+
+    for (i = 0; i < count; i++) {
+        print_field_ref(&refs[i], &values);
+    }
+}
+
+// --health: each disk's own verdict by SMART RETURN STATUS, one command per
+// disk instead of reading and decoding values and thresholds. Returns 2 if
+// a disk reports a failure
+// SMART RETURN STATUS, at the priority of the other SMART commands
+static int disk_smart_status(struct jmraid *jmraid, int port, int *status) {
+    int res;
+
+    jmraid_set_priority(jmraid, JMRAID_PRIO_LOW);
+    res = jmraid_get_disk_smart_status(jmraid, port, status);
+    jmraid_set_priority(jmraid, JMRAID_PRIO_NORMAL);
+    return res;
+}
+
+static int run_health(struct jmraid *jmraid, int standby) {
+    uint8_t resultBuf[SECTORSIZE] __attribute__((aligned(4)));
+    struct jmraid_sata_info sata;
+    char name[16];
+    int i, status, failed = 0, unchecked = 0;
+
+    if (run_query(jmraid, find_query("sata"), resultBuf) != JM_CMD_OK) {
+        if (g_format >= 0) {
+            emit_error(NULL, "sata", "no answer from the controller");
+        } else {
+            print("No answer from the controller\n");
+        }
+        return 1;
+    }
+    parse_jmraid_sata_info(resultBuf + JM_RESULT_OFFSET, &sata);
+
+    for (i = 0; i < JM_PORTS; i++) {
+        const char *verdict;
+
+        snprintf(name, sizeof(name), "smart%d", i);
+        if (!query_needed(find_query(name), &sata)) {
+            continue;
+        }
+        if (standby && disk_in_standby(jmraid, i)) {
+            verdict = "in standby, not checked";
+        } else if (disk_smart_status(jmraid, i, &status)) {
+            verdict = "no answer";
+            unchecked = 1;
+        } else if (status == JMRAID_SMART_PASSED) {
+            verdict = "PASSED";
+        } else if (status == JMRAID_SMART_FAILED) {
+            verdict = "FAILED";
+            failed = 1;
+        } else {
+            verdict = "unknown";
+            unchecked = 1;
+        }
+        if (g_format >= 0) {
+            JM_Out_Begin(&g_out, "health");
+            JM_Out_U64(&g_out, "port", i);
+            JM_Out_Str(&g_out, "model", sata.item[i].model_name);
+            JM_Out_Str(&g_out, "serial", sata.item[i].serial_number);
+            JM_Out_Str(&g_out, "status", verdict);
+            JM_Out_End(&g_out);
+        } else {
+            print("Disk %d (%s %s): %s\n", i, sata.item[i].model_name, sata.item[i].serial_number, verdict);
+        }
+    }
+    // Not knowing is no all clear
+    return failed ? 2 : unchecked ? 1 : 0;
+}
+
+// Daemon mode, the device stays open and awake between queries
+static struct jmraid *daemon_dev;
+
+static int daemon_handler(const char *theQuery, uint8_t *theReply) {
+    const struct jm_query *query = find_query(theQuery);
+    uint32_t res;
+
+    if (!query) {
+        return -1;
+    }
+    res = run_query(daemon_dev, query, theReply);
+    if (res != JM_CMD_OK) {
+        return -1;
+    }
+    return (query->probe[1] ? 2 : 1) * SECTORSIZE;
+}
+
+static int run_client(const char *name, const char *path) {
+    uint8_t reply[JM_DAEMON_MAX_REPLY];
+    const struct jm_query *query = find_query(name);
+    struct jmraid_sata_info sata;
+    int have_sata = 0;
+    uint32_t i;
+
+    if (!query && strcmp(name, "all") != 0) {
+        printf("Unknown query %s\n", name);
+        return 1;
+    }
+    for (i = 0; i < JM_NUM_QUERIES; i++) {
+        // All of them means all of those in use
+        if (query ? query != &jm_queries[i] : !query_needed(&jm_queries[i], have_sata ? &sata : NULL)) {
+            continue;
+        }
+        if (JM_Daemon_Query(path, jm_queries[i].name, reply) < 0) {
+            print("No answer from %s for %s\n", path, jm_queries[i].name);
+            return 1;
+        }
+        if (strcmp(jm_queries[i].name, "sata") == 0) {
+            parse_jmraid_sata_info(reply + JM_RESULT_OFFSET, &sata);
+            have_sata = 1;
+        }
+        output_query(&jm_queries[i], reply);
+    }
+    return 0;
+}
+
+// Publisher mode, decoded state goes to a shared memory segment for
+// readers that never touch the device
+static volatile sig_atomic_t publish_stop;
+
+static void publish_signal(int sig) {
+    (void)sig;
+    publish_stop = 1;
+}
+
+// What the publisher saw at the last poll, so unchanged responses are not
+// decoded again
+struct poll_state {
+    struct jm_shm_snapshot snapshot;
+    uint32_t fingerprint[JM_NUM_QUERIES];
+    uint32_t known;             // Bit n set if fingerprint[n] is that of the decoded query n
+    struct jm_cache thresholds; // SMART thresholds by disk, read once per disk
+    int standby;                // --standby, no SMART from disks in standby
+};
+
+// Run a query, returning 1 if its responses differ from the last poll (and
+// need decoding), 0 if not and -1 if it failed
+static int poll_query(struct jmraid *jmraid, struct poll_state *state, const char *name, uint8_t *resultBuf) {
+    const struct jm_query *query = find_query(name);
+    uint32_t n = query - jm_queries;
+    uint32_t fingerprint, res;
+    char key[JM_CACHE_KEY];
+    int dirty;
+
+    // The sata info in the snapshot is this poll's by the time SMART is read
+    if (query->cached == JM_QUERY_CACHED_THRESHOLDS &&
+        cache_key(query, NULL, &state->snapshot.sata, key, sizeof(key)) == 0) {
+        res = run_query_cached(jmraid, &state->thresholds, UINT32_MAX, query, key, resultBuf, &dirty);
+    } else {
+        res = run_query(jmraid, query, resultBuf);
+    }
+    if (res != JM_CMD_OK) {
+        state->known &= ~(1 << n);
+        return -1;
+    }
+    fingerprint = query_fingerprint(query, resultBuf);
+    if ((state->known & (1 << n)) && state->fingerprint[n] == fingerprint) {
+        return 0;
+    }
+    state->fingerprint[n] = fingerprint;
+    state->known |= 1 << n;
+    return 1;
+}
+
+// A query not sent this poll, decoded afresh once it is sent again
+static void forget_query(struct poll_state *state, const char *name) {
+    state->known &= ~(1 << (find_query(name) - jm_queries));
+}
+
+static int collect_snapshot(struct jmraid *jmraid, struct poll_state *state) {
+    struct jm_shm_snapshot *snapshot = &state->snapshot;
+    uint8_t resultBuf[2*SECTORSIZE] __attribute__((aligned(4)));
+    char name[16];
+    int i, res;
+
+    snapshot->updated = time(NULL);
+
+    if ((res = poll_query(jmraid, state, "chip", resultBuf)) < 0) {
+        return -1;
+    }
+    if (res) {
+        parse_jmraid_chip_info(resultBuf + JM_RESULT_OFFSET, &snapshot->chip);
+    }
+
+    if ((res = poll_query(jmraid, state, "sata", resultBuf)) < 0) {
+        return -1;
+    }
+    if (res) {
+        parse_jmraid_sata_info(resultBuf + JM_RESULT_OFFSET, &snapshot->sata);
+    }
+
+    // Only the RAID ports and disks the sata info shows in use
+    for (i = 0; i < JM_SHM_PORTS; i++) {
+        snprintf(name, sizeof(name), "raid%d", i);
+        if (!query_needed(find_query(name), &snapshot->sata)) {
+            forget_query(state, name);
+            snapshot->raid_valid &= ~(1 << i);
+            memset(&snapshot->raid_port[i], 0, sizeof(snapshot->raid_port[i]));
+            continue;
+        }
+        if ((res = poll_query(jmraid, state, name, resultBuf)) < 0) {
+            return -1;
+        }
+        if (res) {
+            parse_jmraid_raid_port_info(resultBuf + JM_RESULT_OFFSET, &snapshot->raid_port[i]);
+        }
+        snapshot->raid_valid |= 1 << i;
+    }
+
+    for (i = 0; i < JM_SHM_PORTS; i++) {
+        snprintf(name, sizeof(name), "smart%d", i);
+        if (!query_needed(find_query(name), &snapshot->sata)) {
+            forget_query(state, name);
+            res = -1;
+        } else if (state->standby && disk_in_standby(jmraid, i)) {
+            // The values stay those of the last poll it was awake for
+            snapshot->standby |= 1 << i;
+            continue;
+        } else {
+            res = poll_query(jmraid, state, name, resultBuf);
+        }
+        snapshot->standby &= ~(1 << i);
+        if (res < 0) {
+            snapshot->smart_valid &= ~(1 << i);
+            memset(&snapshot->smart[i], 0, sizeof(snapshot->smart[i]));
+            continue;
+        }
+        if (res) {
+            parse_jmraid_disk_smart_info(resultBuf + JM_RESULT_OFFSET, resultBuf + SECTORSIZE + JM_RESULT_OFFSET, &snapshot->smart[i]);
+            snapshot->smart_valid |= 1 << i;
+        }
+        snapshot->smart_read[i] = snapshot->updated;
+    }
+    return 0;
+}
+
+static void run_publisher(struct jmraid *jmraid, const char *path, uint32_t interval, int standby) {
+    struct jm_shm_status *status = JM_Shm_Create(path);
+    static struct poll_state state;
+    struct sigaction sa;
+
+    if (!status) {
+        return;
+    }
+    JM_Cache_Init(&state.thresholds, 0);
+    state.standby = standby;
+
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = publish_signal;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+
+    while (!publish_stop) {
+        if (collect_snapshot(jmraid, &state) == 0) {
+            // Also when nothing changed, the time of the poll is news too
+            JM_Shm_Publish(status, &state.snapshot);
+        } else {
+            printf("Poll failed, keeping the previous snapshot\n");
+        }
+        // Interrupted by the signals above
+        sleep(interval);
+    }
+}
+
+// The published state as records: the poll, then what it read. A disk in
+// standby has a standby record with the time its values were read
+static void emit_status(const struct jm_shm_snapshot *snapshot) {
+    int i;
+
+    JM_Out_Begin(&g_out, "status");
+    JM_Out_U64(&g_out, "generation", snapshot->generation);
+    JM_Out_U64(&g_out, "updated", snapshot->updated);
+    JM_Out_End(&g_out);
+    emit_chip_info(&g_out, &snapshot->chip);
+    emit_sata_info(&g_out, &snapshot->sata);
+    for (i = 0; i < JM_SHM_PORTS; i++) {
+        if (snapshot->raid_valid & (1 << i)) {
+            emit_raid_port_info(&g_out, i, &snapshot->raid_port[i]);
+        }
+    }
+    for (i = 0; i < JM_SHM_PORTS; i++) {
+        if (snapshot->standby & (1 << i)) {
+            JM_Out_Begin(&g_out, "standby");
+            JM_Out_U64(&g_out, "disk", i);
+            JM_Out_U64(&g_out, "read", (snapshot->smart_valid & (1 << i)) ? snapshot->smart_read[i] : 0);
+            JM_Out_End(&g_out);
+        }
+        if (snapshot->smart_valid & (1 << i)) {
+            emit_disk_smart_info(&g_out, i, &snapshot->smart[i]);
+        }
+    }
+}
+
+static int run_status(const char *path) {
+    const struct jm_shm_status *status = JM_Shm_Open(path);
+    struct jm_shm_snapshot snapshot;
+    char when[32] = "?";
+    struct tm *tm;
+    time_t updated;
+    int i;
+
+    if (!status || JM_Shm_Read(status, &snapshot) < 0) {
+        printf("No status published at %s\n", path);
+        return 1;
+    }
+    JM_Shm_Close(status);
+
+    if (g_format >= 0) {
+        emit_status(&snapshot);
+        return 0;
+    }
+
+    updated = snapshot.updated;
+    if ((tm = localtime(&updated)))
+        strftime(when, sizeof(when), "%Y-%m-%d %H:%M:%S", tm);
+    print("Generation %llu, updated %s\n\n", (unsigned long long)snapshot.generation, when);
+    print_chip_info(&snapshot.chip);
+    print("\n");
+    print_sata_info(&snapshot.sata);
+    print("\n");
+    for (i = 0; i < JM_SHM_PORTS; i++) {
+        if (snapshot.raid_valid & (1 << i)) {
+            print("RAID Port %d:\n", i);
+            print_raid_port_info(&snapshot.raid_port[i]);
+            print("\n");
+        }
+    }
+    for (i = 0; i < JM_SHM_PORTS; i++) {
+        if (snapshot.standby & (1 << i)) {
+            print("SMART Info Disk %d:\n", i);
+            if (!(snapshot.smart_valid & (1 << i))) {
+                print("Disk in standby, not read\n\n");
+                continue;
+            }
+            updated = snapshot.smart_read[i];
+            if ((tm = localtime(&updated)))
+                strftime(when, sizeof(when), "%Y-%m-%d %H:%M:%S", tm);
+            print("Disk in standby, as read %s\n", when);
+            print_disk_smart_info(&snapshot.smart[i]);
+            print("\n");
+        } else if (snapshot.smart_valid & (1 << i)) {
+            print("SMART Info Disk %d:\n", i);
+            print_disk_smart_info(&snapshot.smart[i]);
+            print("\n");
+        }
+    }
+    return 0;
+}
+
+// Exporter mode: the publisher's snapshot as OpenMetrics text, served on
+// /metrics and/or written as a node_exporter textfile. A scrape only polls
+// the controller if the last poll is --max-age seconds old or more
+#define JM_METRICS_TYPE "application/openmetrics-text; version=1.0.0; charset=utf-8"
+
+struct exporter {
+    struct jmraid *jmraid;
+    const char *device;         // The device label of every series
+    const char *file;           // Textfile to rewrite after each poll, or NULL
+    uint32_t max_age;
+    struct poll_state state;
+    int polled;                 // Whether polled_at is set
+    uint64_t polled_at;         // CLOCK_MONOTONIC seconds of the last poll
+    int up;                     // Whether the last poll succeeded
+    struct jm_out page;
+    struct jm_out textfile;     // The page in node_exporter's text format
+};
+
+static struct exporter exporter;
+
+static uint64_t monotonic_s(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec;
+}
+
+static void metric_family_type(struct jm_out *out, const char *name, const char *type, const char *help) {
+    JM_Out_Printf(out, "# HELP jmraid_%s %s\n# TYPE jmraid_%s %s\n", name, help, name, type);
+}
+
+static void metric_family(struct jm_out *out, const char *name, const char *help) {
+    metric_family_type(out, name, "gauge", help);
+}
+
+// A label value, with \, " and newlines escaped
+static void metric_escape(struct jm_out *out, const char *value) {
+    for (; *value; value++) {
+        if (*value == '\\' || *value == '"') {
+            JM_Out_Printf(out, "\\%c", *value);
+        } else if (*value == '\n') {
+            JM_Out_Printf(out, "\\n");
+        } else {
+            JM_Out_Printf(out, "%c", *value);
+        }
+    }
+}
+
+static void metric_label(struct jm_out *out, const char *name, const char *value) {
+    JM_Out_Printf(out, ",%s=\"", name);
+    metric_escape(out, value);
+    JM_Out_Printf(out, "\"");
+}
+
+// The start of a sample, up to the labels after the device one
+static void metric_sample(struct jm_out *out, const char *name) {
+    JM_Out_Printf(out, "jmraid_%s{device=\"", name);
+    metric_escape(out, exporter.device);
+    JM_Out_Printf(out, "\"");
+}
+
+static void metric_indexed(struct jm_out *out, const char *name, const char *label, int index, uint64_t value) {
+    char text[16];
+    snprintf(text, sizeof(text), "%d", index);
+    metric_sample(out, name);
+    metric_label(out, label, text);
+    JM_Out_Printf(out, "} %llu\n", (unsigned long long)value);
+}
+
+// OpenMetrics, or the Prometheus text format node_exporter reads, which has
+// no info type and no # EOF
+static void render_metrics(struct jm_out *out, int openmetrics) {
+    const struct jm_shm_snapshot *snapshot = &exporter.state.snapshot;
+    int i, a;
+
+    JM_Out_Reset(out);
+    metric_family(out, "up", "Whether the last poll of the controller succeeded");
+    metric_sample(out, "up");
+    JM_Out_Printf(out, "} %d\n", exporter.up);
+    metric_family(out, "last_poll_timestamp_seconds", "When the controller was last polled");
+    metric_sample(out, "last_poll_timestamp_seconds");
+    JM_Out_Printf(out, "} %llu\n", (unsigned long long)snapshot->updated);
+
+    metric_family(out, "raid_level", "RAID level, 0 RAID 0, 1 RAID 1, 2 JBOD, 3 RAID 3, 4 clone, 5 RAID 5, 6 RAID 10");
+    for (i = 0; i < JM_SHM_PORTS; i++)
+        if (snapshot->raid_valid & (1 << i))
+            metric_indexed(out, "raid_level", "raid", i, snapshot->raid_port[i].level);
+    metric_family(out, "raid_state", "RAID state, 0 broken, 1 degraded, 2 rebuilding, 3 normal, 4 expansion, 5 backup");
+    for (i = 0; i < JM_SHM_PORTS; i++)
+        if (snapshot->raid_valid & (1 << i))
+            metric_indexed(out, "raid_state", "raid", i, snapshot->raid_port[i].state);
+    metric_family(out, "raid_rebuild_progress_ratio", "Rebuild progress of the RAID port, 0 to 1");
+    for (i = 0; i < JM_SHM_PORTS; i++) {
+        const struct jmraid_raid_port_info *raid = &snapshot->raid_port[i];
+        if (snapshot->raid_valid & (1 << i)) {
+            metric_sample(out, "raid_rebuild_progress_ratio");
+            JM_Out_Printf(out, ",raid=\"%d\"} %.4f\n", i, raid->capacity ? (double)raid->rebuild_progress / raid->capacity : 0);
+        }
+    }
+    metric_family(out, "raid_capacity_bytes", "Capacity of the RAID port");
+    for (i = 0; i < JM_SHM_PORTS; i++)
+        if (snapshot->raid_valid & (1 << i))
+            metric_indexed(out, "raid_capacity_bytes", "raid", i, snapshot->raid_port[i].capacity);
+    metric_family(out, "raid_members", "Number of member disks of the RAID port");
+    for (i = 0; i < JM_SHM_PORTS; i++)
+        if (snapshot->raid_valid & (1 << i))
+            metric_indexed(out, "raid_members", "raid", i, snapshot->raid_port[i].member_count);
+
+    metric_family(out, "port_type", "SATA port type, 0 none, 1 hard disk, 2 RAID disk, 3 optical, 4 bad, 5 skip, 6 off, 7 host");
+    for (i = 0; i < JM_SHM_PORTS; i++)
+        metric_indexed(out, "port_type", "port", i, snapshot->sata.item[i].port_type);
+    metric_family(out, "port_speed", "SATA link generation, 0 if not connected");
+    for (i = 0; i < JM_SHM_PORTS; i++)
+        metric_indexed(out, "port_speed", "port", i, snapshot->sata.item[i].port_speed);
+    if (openmetrics) {
+        metric_family_type(out, "disk", "info", "Model and serial number of the disk on the port");
+    } else {
+        metric_family(out, "disk_info", "Model and serial number of the disk on the port");
+    }
+    for (i = 0; i < JM_SHM_PORTS; i++) {
+        const struct jmraid_sata_info_item *item = &snapshot->sata.item[i];
+        char port[16];
+        if (item->port_type == 0x01 || item->port_type == 0x02) {
+            snprintf(port, sizeof(port), "%d", i);
+            metric_sample(out, "disk_info");
+            metric_label(out, "port", port);
+            metric_label(out, "model", item->model_name);
+            metric_label(out, "serial", item->serial_number);
+            JM_Out_Printf(out, "} 1\n");
+        }
+    }
+    metric_family(out, "disk_capacity_bytes", "Capacity of the disk on the port");
+    for (i = 0; i < JM_SHM_PORTS; i++)
+        if (snapshot->sata.item[i].port_type == 0x01 || snapshot->sata.item[i].port_type == 0x02)
+            metric_indexed(out, "disk_capacity_bytes", "port", i, snapshot->sata.item[i].capacity);
+    metric_family(out, "disk_standby", "Whether the disk was in standby, its SMART values are from before");
+    for (i = 0; i < JM_SHM_PORTS; i++)
+        if ((snapshot->smart_valid | snapshot->standby) & (1 << i))
+            metric_indexed(out, "disk_standby", "port", i, (snapshot->standby >> i) & 1);
+
+    {
+        static const char *const names[4] = { "smart_value", "smart_worst", "smart_threshold", "smart_raw" };
+        static const char *const help[4] = { "Normalized value of the SMART attribute", "Worst normalized value of the SMART attribute",
+                                             "Threshold of the SMART attribute", "Raw value of the SMART attribute" };
+        int part;
+        for (part = 0; part < 4; part++) {
+            metric_family(out, names[part], help[part]);
+            for (i = 0; i < JM_SHM_PORTS; i++) {
+                if (!(snapshot->smart_valid & (1 << i)))
+                    continue;
+                for (a = 0; a < 30; a++) {
+                    const struct jmraid_disk_smart_info_attribute *attr = &snapshot->smart[i].attribute[a];
+                    uint64_t value = part == 0 ? attr->current_value : part == 1 ? attr->worst_value : part == 2 ? attr->threshold : attr->raw_value;
+                    char text[16];
+                    if (attr->id == 0)
+                        continue;
+                    metric_sample(out, names[part]);
+                    snprintf(text, sizeof(text), "%d", i);
+                    metric_label(out, "port", text);
+                    snprintf(text, sizeof(text), "%u", attr->id);
+                    metric_label(out, "id", text);
+                    metric_label(out, "name", get_smart_attribute_name(attr->id));
+                    JM_Out_Printf(out, "} %llu\n", (unsigned long long)value);
+                }
+            }
+        }
+    }
+    if (openmetrics) {
+        JM_Out_Printf(out, "# EOF\n");
+    }
+}
+
+static void exporter_poll(void) {
+    exporter.up = collect_snapshot(exporter.jmraid, &exporter.state) == 0;
+    exporter.polled = 1;
+    exporter.polled_at = monotonic_s();
+    render_metrics(&exporter.page, 1);
+    if (exporter.file) {
+        render_metrics(&exporter.textfile, 0);
+        JM_Out_Save(&exporter.textfile, exporter.file);
+    }
+}
+
+static const char *exporter_handler(const char *path, struct jm_out *body) {
+    if (strcmp(path, "/metrics") != 0) {
+        return NULL;
+    }
+    // However often it is scraped, the device sees at most one poll per max age
+    if (!exporter.polled || monotonic_s() - exporter.polled_at >= exporter.max_age) {
+        exporter_poll();
+    }
+    JM_Out_Printf(body, "%.*s", (int)exporter.page.len, (const char *)exporter.page.buf);
+    return JM_METRICS_TYPE;
+}
+
+static void run_exporter(struct jmraid *jmraid, const char *device, const char *listen, const char *file,
+                         uint32_t max_age, uint32_t interval, int standby) {
+    struct sigaction sa;
+
+    exporter.jmraid = jmraid;
+    exporter.device = device;
+    exporter.file = file;
+    exporter.max_age = max_age;
+    exporter.state.standby = standby;
+    JM_Cache_Init(&exporter.state.thresholds, 0);
+    JM_Out_Init(&exporter.page, -1, JM_OUT_TEXT);
+    JM_Out_Init(&exporter.textfile, -1, JM_OUT_TEXT);
+
+    if (listen) {
+        JM_Http_Run(listen, exporter_handler);
+    } else {
+        memset(&sa, 0, sizeof(sa));
+        sa.sa_handler = publish_signal;
+        sigaction(SIGINT, &sa, NULL);
+        sigaction(SIGTERM, &sa, NULL);
+        while (!publish_stop) {
+            exporter_poll();
+            sleep(interval);
+        }
+    }
+    JM_Out_Free(&exporter.page);
+    JM_Out_Free(&exporter.textfile);
+}
+
+// Watch mode: the device stays open and each class of queries is polled at
+// its own interval, on a one second timer wheel. The classes due at the same
+// tick are sent together, between one backup and one restore of the sector
+enum {
+    JM_WATCH_RAID,              // RAID port info
+    JM_WATCH_SATA,              // sata info and SATA port info
+    JM_WATCH_SMART,
+    JM_WATCH_CLASSES
+};
+
+static const char *const watch_class_name[JM_WATCH_CLASSES] = { "raid", "sata", "smart" };
+static uint32_t watch_interval[JM_WATCH_CLASSES] = { 5, 30, 3600 };
+
+// "raid=5,smart=600": the intervals in seconds that differ from the defaults
+static int parse_watch(const char *spec) {
+    while (spec && *spec) {
+        const char *end = spec + strcspn(spec, ",");
+        const char *eq = memchr(spec, '=', end - spec);
+        int c;
+
+        for (c = 0; c < JM_WATCH_CLASSES; c++) {
+            if (eq && (size_t)(eq - spec) == strlen(watch_class_name[c]) && strncmp(spec, watch_class_name[c], eq - spec) == 0) {
+                break;
+            }
+        }
+        if (c == JM_WATCH_CLASSES || (watch_interval[c] = strtoul(eq + 1, NULL, 0)) == 0) {
+            printf("Bad --watch interval %.*s\n", (int)(end - spec), spec);
+            return -1;
+        }
+        spec = *end ? end + 1 : end;
+    }
+    return 0;
+}
+
+static int watch_class(const struct jm_query *query) {
+    switch (query->kind) {
+    case JM_QUERY_VOLUME: return JM_WATCH_RAID;
+    case JM_QUERY_DISK:   return JM_WATCH_SMART;
+    default:              return JM_WATCH_SATA;
+    }
+}
+
+struct watch_state {
+    struct jmraid_sata_info sata;
+    int have_sata;
+    struct jm_cache thresholds; // SMART thresholds by disk, read once per disk
+    int standby;
+};
+
+// The queries of the classes in due, the chip info only the first time
+static void watch_tick(struct jmraid *jmraid, struct watch_state *state, uint32_t due, int first) {
+    uint8_t resultBuf[2*SECTORSIZE] __attribute__((aligned(4)));
+    char when[32] = "?";
+    time_t now = time(NULL);
+    struct tm *tm;
+    uint32_t i;
+
+    if (g_format >= 0) {
+        JM_Out_Begin(&g_out, "tick");
+        JM_Out_U64(&g_out, "time", now);
+        JM_Out_End(&g_out);
+    } else {
+        if ((tm = localtime(&now)))
+            strftime(when, sizeof(when), "%Y-%m-%d %H:%M:%S", tm);
+        print("== %s ==\n\n", when);
+    }
+
+    for (i = 0; i < JM_NUM_QUERIES; i++) {
+        const struct jm_query *query = &jm_queries[i];
+        char key[JM_CACHE_KEY];
+        uint32_t res;
+        int dirty;
+
+        if (!(due & (1 << watch_class(query))) || (strcmp(query->name, "chip") == 0 && !first) ||
+            !query_needed(query, state->have_sata ? &state->sata : NULL)) {
+            continue;
+        }
+        if (state->standby && query->kind == JM_QUERY_DISK && disk_in_standby(jmraid, query->index)) {
+            report_budget(jmraid, query);
+            print_standby_query(NULL, query, NULL);
+            continue;
+        }
+        if (query->cached == JM_QUERY_CACHED_THRESHOLDS && state->have_sata &&
+            cache_key(query, NULL, &state->sata, key, sizeof(key)) == 0) {
+            res = run_query_cached(jmraid, &state->thresholds, UINT32_MAX, query, key, resultBuf, &dirty);
+        } else {
+            res = run_query(jmraid, query, resultBuf);
+        }
+        report_budget(jmraid, query);
+        if (res != JM_CMD_OK) {
+            if (g_format >= 0) {
+                emit_error(NULL, query->name, "no valid response");
+            } else {
+                print("Warning: no valid response to %s\n", query->name);
+            }
+            continue;
+        }
+        if (strcmp(query->name, "sata") == 0) {
+            parse_jmraid_sata_info(resultBuf + JM_RESULT_OFFSET, &state->sata);
+            state->have_sata = 1;
+        }
+        output_query(query, resultBuf);
+    }
+}
+
+// With --idle the sata and SMART classes are not urgent: once due they wait
+// for the disk to be idle, no I/O in flight and busy at most
+// JM_WATCH_IDLE_BUSY per mille of the time, for JM_WATCH_IDLE_SETTLE seconds
+// in a row. Or for idle_deadline seconds, then they are sent anyway
+#define JM_WATCH_IDLE_BUSY   (20)
+#define JM_WATCH_IDLE_SETTLE (2)
+
+// A uevent about a device behind the controller, any block or sg device if
+// where that is is not known. Several come for one disk (the disk, its
+// partitions, its sg node), they are taken together: read until none of
+// them comes for JM_WATCH_UEVENT_SETTLE ms, or the next tick is due
+#define JM_WATCH_UEVENT_SETTLE (500)
+
+static int watch_uevent_wanted(const struct jm_uevent *event, const char *host) {
+    size_t len = strlen(host);
+
+    if (strcmp(event->action, "add") != 0 && strcmp(event->action, "remove") != 0 &&
+        strcmp(event->action, "change") != 0) {
+        return 0;
+    }
+    if (strcmp(event->subsystem, "block") != 0 && strcmp(event->subsystem, "scsi_generic") != 0) {
+        return 0;
+    }
+    return !len || (strncmp(event->devpath, host, len) == 0 && (event->devpath[len] == '/' || !event->devpath[len]));
+}
+
+// Sleeps until the time in until, or returns 1 earlier with the last wanted
+// uevent in event, action "lost" if some were lost (any may have been wanted)
+static int64_t watch_ms(const struct timespec *ts) {
+    return (int64_t)ts->tv_sec * 1000 + ts->tv_nsec / 1000000;
+}
+
+static int watch_wait(int fd, const char *host, const struct timespec *until, struct jm_uevent *event) {
+    struct jm_uevent ev;
+    int64_t end = watch_ms(until), settled = 0;
+    int got = 0, res;
+
+    if (fd < 0) {
+        clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, until, NULL);
+        return 0;
+    }
+    while (!publish_stop) {
+        struct pollfd pfd = { fd, POLLIN, 0 };
+        struct timespec now;
+        int64_t limit = got && settled < end ? settled : end;
+
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        if (watch_ms(&now) >= limit) {
+            break;
+        }
+        // Interrupted by the signals of run_watch()
+        if (poll(&pfd, 1, limit - watch_ms(&now)) <= 0) {
+            break;
+        }
+        while ((res = JM_Uevent_Read(fd, &ev)) != 0) {
+            if (res < 0 && errno == ENOBUFS) {
+                memset(&ev, 0, sizeof(ev));
+                strcpy(ev.action, "lost");
+            } else if (res < 0) {
+                // Not going to get better, the ticks go on without uevents
+                perror("uevent");
+                clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, until, NULL);
+                return got;
+            } else if (!watch_uevent_wanted(&ev, host)) {
+                // Only the wanted ones hold the poll back
+                continue;
+            }
+            *event = ev;
+            got = 1;
+            clock_gettime(CLOCK_MONOTONIC, &now);
+            settled = watch_ms(&now) + JM_WATCH_UEVENT_SETTLE;
+        }
+    }
+    return got;
+}
+
+static void run_watch(struct jmraid *jmraid, int standby, const char *device, uint32_t idle_deadline) {
+    struct jm_wheel_timer timer[JM_WATCH_CLASSES];
+    static struct watch_state state;
+    struct jm_wheel wheel;
+    struct jm_idle idle;
+    struct timespec next;
+    struct sigaction sa;
+    uint32_t pending = 0, pending_since[JM_WATCH_CLASSES];
+    struct jm_uevent event;
+    char host[256] = "";
+    int c, first = 1, uevent_fd;
+
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = publish_signal;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+
+    JM_Cache_Init(&state.thresholds, 0);
+    state.standby = standby;
+    JM_Wheel_Init(&wheel);
+    for (c = 0; c < JM_WATCH_CLASSES; c++) {
+        timer[c].id = c;
+        JM_Wheel_Add(&wheel, &timer[c], 1);
+    }
+    if (idle_deadline && JM_Idle_Open(&idle, device) < 0) {
+        fprintf(stderr, "No I/O statistics for %s, --idle has no effect\n", device);
+    }
+    // Disks plugged in or swapped are noticed at once, not at the next poll
+    if ((uevent_fd = JM_Uevent_Open()) < 0) {
+        fprintf(stderr, "No uevents, changes only show at the next poll\n");
+    } else if (JM_Uevent_Host(device, host, sizeof(host)) < 0) {
+        host[0] = 0;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &next);
+    while (!publish_stop) {
+        struct jm_wheel_timer *t, *t_next;
+        uint32_t due = 0, forced = 0;
+
+        for (t = JM_Wheel_Tick(&wheel); t; t = t_next) {
+            t_next = t->next;
+            // The first time everything, the sata info says what there is
+            if (idle_deadline && !first && t->id != JM_WATCH_RAID) {
+                if (!(pending & (1 << t->id))) {
+                    pending_since[t->id] = wheel.now;
+                }
+                pending |= 1 << t->id;
+            } else {
+                due |= 1 << t->id;
+            }
+            JM_Wheel_Add(&wheel, t, watch_interval[t->id]);
+        }
+        // Sampled every second, an idle window has to last a while
+        if (idle_deadline) {
+            int quiet = JM_Idle_Sample(&idle, JM_WATCH_IDLE_BUSY, JM_WATCH_IDLE_SETTLE);
+
+            for (c = 0; c < JM_WATCH_CLASSES; c++) {
+                if (!(pending & (1 << c))) {
+                    continue;
+                }
+                if (quiet || wheel.now - pending_since[c] >= idle_deadline) {
+                    due |= 1 << c;
+                    pending &= ~(1 << c);
+                    if (!quiet) {
+                        forced |= 1 << c;
+                    }
+                }
+            }
+        }
+        if (due) {
+            watch_tick(jmraid, &state, due, first);
+            first = 0;
+            for (c = 0; c < JM_WATCH_CLASSES; c++) {
+                if (!(forced & (1 << c))) {
+                    continue;
+                }
+                if (g_format >= 0) {
+                    JM_Out_Begin(&g_out, "forced");
+                    JM_Out_Str(&g_out, "class", watch_class_name[c]);
+                    JM_Out_U64(&g_out, "deferred_s", wheel.now - pending_since[c]);
+                    JM_Out_U64(&g_out, "busy_permille", idle.busy);
+                    JM_Out_End(&g_out);
+                } else {
+                    print("%s sent after %u s without an idle window (disk %u.%u%% busy)\n", watch_class_name[c],
+                          wheel.now - pending_since[c], idle.busy / 10, idle.busy % 10);
+                }
+            }
+            // The sector is only borrowed while commands are going
+            jmraid_release(jmraid);
+            fflush(stdout);
+            JM_Out_Flush(&g_out);
+        }
+
+        // Ticks on the second, however long the commands took. Interrupted
+        // by the signals above
+        next.tv_sec++;
+        while (watch_wait(uevent_fd, host, &next, &event) && !publish_stop) {
+            // Another disk means other serial numbers, the sata class reads
+            // them again and the SMART thresholds are read afresh
+            if (g_format >= 0) {
+                JM_Out_Begin(&g_out, "uevent");
+                JM_Out_Str(&g_out, "action", event.action);
+                JM_Out_Str(&g_out, "device", event.devname[0] ? event.devname : event.devpath);
+                JM_Out_End(&g_out);
+            } else if (strcmp(event.action, "lost") == 0) {
+                print("uevent: some lost, the socket overflowed\n");
+            } else {
+                print("uevent: %s %s\n", event.action, event.devname[0] ? event.devname : event.devpath);
+            }
+            JM_Cache_Init(&state.thresholds, 0);
+            watch_tick(jmraid, &state, 1 << JM_WATCH_SATA, first);
+            first = 0;
+            jmraid_release(jmraid);
+            fflush(stdout);
+            JM_Out_Flush(&g_out);
+        }
+    }
+    if (idle_deadline) {
+        JM_Idle_Close(&idle);
+    }
+    if (uevent_fd >= 0) {
+        close(uevent_fd);
+    }
+}
+
+// Several controllers, polled all at once instead of one after the other.
+// In two rounds: the chip and sata info of all of them, then for each
+// controller only the queries its sata info shows are needed
+struct async_round {
+    struct jm_async_ctrl *ctrls;
+    struct jm_async_probe *probes; // JM_ASYNC_MAX_PROBES per controller
+    uint8_t *results;           // As many sectors
+};
+
+static int async_round_alloc(struct async_round *round, int count) {
+    round->ctrls = calloc(count, sizeof(*round->ctrls));
+    round->probes = calloc((size_t)count * JM_ASYNC_MAX_PROBES, sizeof(*round->probes));
+    round->results = malloc((size_t)count * JM_ASYNC_MAX_PROBES * SECTORSIZE);
+    return round->ctrls && round->probes && round->results ? 0 : -1;
+}
+
+static void async_round_free(struct async_round *round) {
+    free(round->ctrls);
+    free(round->probes);
+    free(round->results);
+}
+
+// Plan the queries of a round for the controller in slot c, remembering
+// where each one's responses go in where[] (its first probe, plus
+// JM_ASYNC_MAX_PROBES in the second round)
+static void async_round_plan(struct async_round *round, int c, int second, const struct jmraid_sata_info *sata, uint32_t *where) {
+    struct jm_async_ctrl *ctrl = &round->ctrls[c];
+    struct jm_async_probe *probes = round->probes + (size_t)c * JM_ASYNC_MAX_PROBES;
+    uint32_t numProbes = 0, q, i;
+
+    ctrl->probes = probes;
+    ctrl->results = round->results + (size_t)c * JM_ASYNC_MAX_PROBES * SECTORSIZE;
+    for (q = 0; q < JM_NUM_QUERIES; q++) {
+        const struct jm_query *query = &jm_queries[q];
+        if ((query->kind != JM_QUERY_CONTROLLER) != second || !query_needed(query, sata)) {
+            continue;
+        }
+        // Both SMART commands included, back to back
+        where[q] = numProbes + (second ? JM_ASYNC_MAX_PROBES : 0);
+        for (i = 0; i < 2 && query->probe[i]; i++) {
+            probes[numProbes].cmd = query->probe[i];
+            probes[numProbes].len = query->probe_len[i];
+            numProbes++;
+        }
+    }
+    ctrl->numProbes = numProbes;
+}
+
+static int run_async(int count, char *argv[], int transport) {
+    struct async_round rounds[2];
+    int *slot;                  // Per round and controller, its place in that round's ctrls or -1
+    uint32_t *where;            // Per controller and query, see async_round_plan(), -1 if not sent
+    uint32_t sata_query = find_query("sata") - jm_queries;
+    uint32_t q;
+    int c, r, failed = 0;
+
+    memset(rounds, 0, sizeof(rounds));
+    slot = malloc(2 * count * sizeof(*slot));
+    where = malloc((size_t)count * JM_NUM_QUERIES * sizeof(*where));
+    if (!slot || !where || async_round_alloc(&rounds[0], count) < 0 || async_round_alloc(&rounds[1], count) < 0) {
+        printf("Out of memory\n");
+        return 1;
+    }
+    memset(where, 0xff, (size_t)count * JM_NUM_QUERIES * sizeof(*where));
+
+    for (r = 0; r < 2; r++) {
+        int n = 0;
+
+        for (c = 0; c < count; c++) {
+            uint32_t *ctrlWhere = where + (size_t)c * JM_NUM_QUERIES;
+            struct jm_async_ctrl *ctrl = &rounds[r].ctrls[n];
+            struct jmraid_sata_info sata;
+            const struct jmraid_sata_info *have_sata = NULL;
+
+            slot[r*count + c] = -1;
+            if (r == 1) {
+                const struct jm_async_ctrl *prev = &rounds[0].ctrls[slot[c]];
+                if (prev->error) {
+                    continue;
+                }
+                if (prev->status[ctrlWhere[sata_query]] == JM_CMD_OK) {
+                    parse_jmraid_sata_info(prev->results + ctrlWhere[sata_query] * SECTORSIZE + JM_RESULT_OFFSET, &sata);
+                    have_sata = &sata;
+                }
+            }
+            ctrl->path = argv[2*c];
+            if (jmraid_controller_cmd(argv[2*c + 1], &ctrl->scrambled_cmd) < 0) {
+                printf("Controller not specified for %s\n", argv[2*c]);
+                return 1;
+            }
+            async_round_plan(&rounds[r], n, r, have_sata, ctrlWhere);
+            // Nothing in use behind this controller, no need to borrow its sector again
+            if (ctrl->numProbes) {
+                slot[r*count + c] = n++;
+            }
+        }
+        if (n && JM_Async_Run(rounds[r].ctrls, n, transport)) {
+            failed = 1;
+        }
+    }
+
+    for (c = 0; c < count; c++) {
+        const uint32_t *ctrlWhere = where + (size_t)c * JM_NUM_QUERIES;
+        const struct jm_async_ctrl *second = slot[count + c] >= 0 ? &rounds[1].ctrls[slot[count + c]] : NULL;
+
+        if (g_format >= 0) {
+            JM_Out_Begin(&g_out, "controller");
+            JM_Out_Str(&g_out, "device", argv[2*c]);
+            JM_Out_Str(&g_out, "type", argv[2*c + 1]);
+            JM_Out_U64(&g_out, "failed", rounds[0].ctrls[slot[c]].error || (second && second->error));
+            JM_Out_End(&g_out);
+        } else {
+            print("== %s (%s) ==\n\n", argv[2*c], argv[2*c + 1]);
+        }
+        if (rounds[0].ctrls[slot[c]].error) {
+            if (g_format >= 0) {
+                emit_error(argv[2*c], NULL, "polling failed");
+            } else {
+                print("Polling failed\n\n");
+            }
+            continue;
+        }
+        for (q = 0; q < JM_NUM_QUERIES; q++) {
+            const struct jm_async_ctrl *ctrl = ctrlWhere[q] < JM_ASYNC_MAX_PROBES ? &rounds[0].ctrls[slot[c]] : second;
+            uint32_t w = ctrlWhere[q] % JM_ASYNC_MAX_PROBES;
+
+            if (ctrlWhere[q] == (uint32_t)-1 || !ctrl || ctrl->error) {
+                continue;
+            }
+            if (ctrl->status[w] != JM_CMD_OK) {
+                if (g_format >= 0) {
+                    emit_error(argv[2*c], jm_queries[q].name, "no valid response");
+                } else {
+                    print("Warning: no valid response to %s\n", jm_queries[q].name);
+                }
+                continue;
+            }
+            output_query(&jm_queries[q], ctrl->results + w * SECTORSIZE);
+        }
+        if (second && second->error) {
+            if (g_format >= 0) {
+                emit_error(argv[2*c], NULL, "polling failed");
+            } else {
+                print("Polling failed\n\n");
+            }
+        }
+    }
+    // The sector buffers of all controllers come from the pool, the heap is
+    // only used for more than it holds
+    if (g_format >= 0) {
+        JM_Out_Begin(&g_out, "buffers");
+        JM_Out_U64(&g_out, "heap_allocations", JM_Buf_Allocs());
+        JM_Out_End(&g_out);
+    } else {
+        print("Sector buffers: %lu heap allocations\n", JM_Buf_Allocs());
+    }
+    free(slot);
+    free(where);
+    async_round_free(&rounds[0]);
+    async_round_free(&rounds[1]);
+    return failed;
+}
+
+// --budget <rate>[/<burst>], commands per second and how many may go at
+// once, by default as many as a second's worth
+static int parse_budget(const char *spec, double *rate, uint32_t *burst) {
+    char *end;
+
+    *rate = strtod(spec, &end);
+    *burst = *rate;
+    if (*burst < *rate) {
+        (*burst)++;
+    }
+    if (*end == '/') {
+        *burst = strtoul(end + 1, &end, 0);
+    }
+    if (*end || !(*rate > 0) || *burst < 1) {
+        printf("Bad budget %s, <commands per second>[/<burst>]\n", spec);
+        return -1;
+    }
+    return 0;
+}
+
+static void usage(void) {
+    printf("Usage : JMraidcon [--mmap-io] [--cache <file> [--cache-ttl <s>]] [--changes <file> [--diff]] [--standby] [--format <f>] /dev/sd<X> <jms56x | jmb39x>\n"
+           "        JMraidcon [--mmap-io] --fields <field,...> /dev/sd<X> <jms56x | jmb39x>\n"
+           "        JMraidcon [--mmap-io] --health [--standby] /dev/sd<X> <jms56x | jmb39x>\n"
+           "        JMraidcon [--mmap-io] --daemon <socket> [--coalesce <ms>] /dev/sd<X> <jms56x | jmb39x>\n"
+           "        JMraidcon [--uring] [--format <f>] /dev/sd<X> <jms56x | jmb39x> [/dev/sd<Y> <jms56x | jmb39x> ...]\n"
+           "        JMraidcon [--mmap-io] --publish <file> [--interval <s>] [--standby] /dev/sd<X> <jms56x | jmb39x>\n"
+           "        JMraidcon [--mmap-io] --watch[=raid=<s>,sata=<s>,smart=<s>] [--idle[=<s>]] [--standby] [--format <f>] /dev/sd<X> <jms56x | jmb39x>\n"
+           "        JMraidcon [--mmap-io] --metrics-listen <[host:]port> [--max-age <s>] [--metrics-file <file>] [--standby] /dev/sd<X> <jms56x | jmb39x>\n"
+           "        JMraidcon [--mmap-io] --metrics-file <file> [--interval <s>] [--standby] /dev/sd<X> <jms56x | jmb39x>\n"
+           "        JMraidcon [--format <f>] --query <chip | sata | raid<N> | port<N> | smart<N> | all> <socket>\n"
+           "        JMraidcon [--format <f>] --status <file>\n"
+           "--format <text | json | csv | binary> prints records instead\n"
+           "--budget <rate>[/<burst>] limits the commands per second to the controller, SMART reads yield to the rest\n");
+}
+
+int main(int argc, char * argv[])
+{
+    struct jmraid *jmraid;
+    int opt;
+    uint8_t resultBuf[2*SECTORSIZE] __attribute__((aligned(4)));
+    uint32_t scrambled_cmd_code;
+    uint32_t i;
+    const char *daemon_path = NULL;
+    const char *query_name = NULL;
+    const char *publish_path = NULL;
+    const char *status_path = NULL;
+    const char *cache_path = NULL;
+    const char *changes_path = NULL;
+    const char *fields = NULL;
+    const char *metrics_listen = NULL;
+    const char *metrics_file = NULL;
+    uint32_t max_age = 15;
+    double budget_rate = 0;
+    uint32_t budget_burst = 0;
+    int watch = 0;
+    uint32_t idle_deadline = 0;
+    int diff = 0;
+    int standby = 0;
+    int health = 0;
+    int exit_code = 0;
+    int transport = -1;
+    int mmap_io = 0;
+    uint32_t coalesce_ms = 1000;
+    uint32_t interval = 60;
+    uint32_t cache_ttl = 86400;
+    static const struct option long_options[] = {
+        { "daemon",   required_argument, NULL, 'D' },
+        { "coalesce", required_argument, NULL, 'c' },
+        { "query",    required_argument, NULL, 'q' },
+        { "publish",  required_argument, NULL, 'P' },
+        { "interval", required_argument, NULL, 'i' },
+        { "status",   required_argument, NULL, 's' },
+        { "uring",    no_argument,       NULL, 'u' },
+        { "mmap-io",  no_argument,       NULL, 'm' },
+        { "cache",    required_argument, NULL, 'C' },
+        { "cache-ttl", required_argument, NULL, 't' },
+        { "changes",  required_argument, NULL, 'S' },
+        { "diff",     no_argument,       NULL, 'd' },
+        { "fields",   required_argument, NULL, 'F' },
+        { "standby",  no_argument,       NULL, 'b' },
+        { "health",   no_argument,       NULL, 'H' },
+        { "format",   required_argument, NULL, 'f' },
+        { "metrics-listen", required_argument, NULL, 'L' },
+        { "metrics-file", required_argument, NULL, 'M' },
+        { "max-age",  required_argument, NULL, 'A' },
+        { "watch",    optional_argument, NULL, 'W' },
+        { "budget",   required_argument, NULL, 'B' },
+        { "idle",     optional_argument, NULL, 'I' },
+        { NULL, 0, NULL, 0 }
+    };
+
+/*  printf("JMraidcon version x, Copyright (C) 2010 Werner Johansson\n" \
+        "JMraidcon comes with ABSOLUTELY NO WARRANTY.\n" \
+        "This is free software, and you are welcome\n" \
+        "to redistribute it under certain conditions.\n\n" );
+*/
+
+    while ((opt = getopt_long(argc, argv, "D:c:q:P:i:s:uC:t:S:dF:", long_options, NULL)) != -1) {
+        switch (opt) {
+        case 'D': daemon_path = optarg; break;
+        case 'c': coalesce_ms = strtoul(optarg, NULL, 0); break;
+        case 'q': query_name = optarg; break;
+        case 'P': publish_path = optarg; break;
+        case 'i': interval = strtoul(optarg, NULL, 0); break;
+        case 's': status_path = optarg; break;
+        case 'u': transport = JM_ASYNC_URING; break;
+        case 'm': mmap_io = 1; break;
+        case 'C': cache_path = optarg; break;
+        case 't': cache_ttl = strtoul(optarg, NULL, 0); break;
+        case 'S': changes_path = optarg; break;
+        case 'd': diff = 1; break;
+        case 'F': fields = optarg; break;
+        case 'b': standby = 1; break;
+        case 'H': health = 1; break;
+        case 'L': metrics_listen = optarg; break;
+        case 'M': metrics_file = optarg; break;
+        case 'A': max_age = strtoul(optarg, NULL, 0); break;
+        case 'W':
+            if (parse_watch(optarg) < 0) {
+                return 1;
+            }
+            watch = 1;
+            break;
+        case 'I': idle_deadline = optarg ? strtoul(optarg, NULL, 0) : 600; break;
+        case 'B':
+            if (parse_budget(optarg, &budget_rate, &budget_burst) < 0) {
+                return 1;
+            }
+            break;
+        case 'f':
+            if ((g_format = JM_Out_Format(optarg)) < 0) {
+                usage();
+                return 1;
+            }
+            break;
+        default: usage(); return 1;
+        }
+    }
+    argc -= optind - 1;
+    argv += optind - 1;
+
+    build_probes();
+    JM_Out_Init(&g_out, STDOUT_FILENO, g_format);
+    atexit(flush_output);
+
+    if (status_path) {
+        return run_status(status_path);
+    }
+
+    if (query_name) {
+        if (2 != argc) {
+            usage();
+            return 1;
+        }
+        return run_client(query_name, argv[1]);
+    }
+
+    if (argc >= 3 && (argc & 1) && !daemon_path && !publish_path && !metrics_listen && !metrics_file && !watch && (argc > 3 || transport >= 0)) {
+        return run_async((argc - 1) / 2, argv + 1, transport >= 0 ? transport : JM_ASYNC_SG);
+    }
+    if (3 != argc) {
+        usage();
+        return 1;
+    }
+
+    if (fields && parse_fields(fields) < 0) {
+        return 1;
+    }
+
+    if (jmraid_controller_cmd(argv[2], &scrambled_cmd_code) < 0) {
+        printf("Controller not specified");
+        return 1;
+    }
+    if (g_format < 0) {
+        printf("Using %s with sector 254 (0xfe)\n\n", strcmp(argv[2], "jms56x") == 0 ? "JMS56x" : "JMB39x");
+    }
+
+    if (!(jmraid = jmraid_open(argv[1], argv[2], mmap_io ? JMRAID_MMAP_IO : 0))) {
+        return 1;
+    }
+    if (budget_rate > 0) {
+        jmraid_set_budget(jmraid, budget_rate, budget_burst);
+    }
+
+    // A controller that already answered scrambled commands (a previous run a
+    // moment ago) needs no new handshake, the library only wakes it up if
+    // the first command gets no proper answer
+    if (daemon_path) {
+        // The sector stays borrowed for as long as the daemon runs, which
+        // keeps the controller awake from the start
+        run_query(jmraid, &jm_queries[0], resultBuf);
+        daemon_dev = jmraid;
+        JM_Daemon_Run(daemon_path, daemon_handler, coalesce_ms);
+    } else if (publish_path) {
+        run_publisher(jmraid, publish_path, interval, standby);
+    } else if (metrics_listen || metrics_file) {
+        run_exporter(jmraid, argv[1], metrics_listen, metrics_file, max_age, interval, standby);
+    } else if (watch) {
+        run_watch(jmraid, standby, argv[1], idle_deadline);
+    } else if (fields) {
+        run_fields(jmraid);
+    } else if (health) {
+        exit_code = run_health(jmraid, standby);
+    } else {
+        struct jm_cache cache, state;
+        struct jmraid_chip_info chip;
+        struct jmraid_sata_info sata;
+        int have_chip = 0, have_sata = 0, dirty = 0, state_dirty = 0;
+        char ident[JM_CACHE_DEVICE];
+
+        // The chip info is cached under no key at all, a file filled from
+        // another controller of the same type must not count
+        JM_Cache_Device(argv[1], ident, sizeof(ident));
+        if (cache_path) {
+            JM_Cache_Load(cache_path, scrambled_cmd_code, ident, &cache);
+        }
+        if (changes_path) {
+            JM_Cache_Load(changes_path, scrambled_cmd_code, ident, &state);
+        }
+
+        for (i = 0; i < JM_NUM_QUERIES; i++) {
+            const struct jm_query *query = &jm_queries[i];
+            char key[JM_CACHE_KEY];
+            int have_key;
+            uint32_t res;
+
+            if (!query_needed(query, have_sata ? &sata : NULL)) {
+                continue;
+            }
+            have_key = cache_path && query->cached &&
+                cache_key(query, have_chip ? &chip : NULL, have_sata ? &sata : NULL, key, sizeof(key)) == 0;
+            if (standby && query->kind == JM_QUERY_DISK && disk_in_standby(jmraid, query->index)) {
+                report_budget(jmraid, query);
+                print_standby_query(cache_path ? &cache : NULL, query, have_key ? key : NULL);
+                continue;
+            }
+            if (have_key) {
+                res = run_query_cached(jmraid, &cache, cache_ttl, query, key, resultBuf, &dirty);
+                // The values too, to stand in while the disk is in standby
+                if (standby && res == JM_CMD_OK && query->kind == JM_QUERY_DISK) {
+                    JM_Cache_Put(&cache, query->name, key, resultBuf);
+                    dirty = 1;
+                }
+            } else {
+                res = run_query(jmraid, query, resultBuf);
+            }
+            report_budget(jmraid, query);
+            if (res == JM_CMD_OK && strcmp(query->name, "chip") == 0) {
+                parse_jmraid_chip_info(resultBuf + JM_RESULT_OFFSET, &chip);
+                have_chip = 1;
+            } else if (res == JM_CMD_OK && strcmp(query->name, "sata") == 0) {
+                parse_jmraid_sata_info(resultBuf + JM_RESULT_OFFSET, &sata);
+                have_sata = 1;
+            }
+
+            if (changes_path && res == JM_CMD_OK) {
+                uint32_t fingerprint = query_fingerprint(query, resultBuf);
+
+                // Same answer as last time, nothing to decode or print
+                if (query_unchanged(&state, query, fingerprint)) {
+                    if (g_format >= 0) {
+                        JM_Out_Begin(&g_out, "unchanged");
+                        JM_Out_Str(&g_out, "query", query->name);
+                        JM_Out_End(&g_out);
+                    } else {
+                        print("%s unchanged\n", query->name);
+                    }
+                    continue;
+                }
+                if (g_format >= 0 || !diff || print_query_diff(&state, query, resultBuf) < 0) {
+                    output_query(query, resultBuf);
+                }
+                store_query(&state, query, fingerprint, resultBuf);
+                state_dirty = 1;
+                continue;
+            }
+            output_query(query, resultBuf);
+        }
+
+        if (dirty) {
+            JM_Cache_Save(cache_path, &cache);
+        }
+        if (state_dirty) {
+            JM_Cache_Save(changes_path, &state);
+        }
+    }
+
+    // Restores the original data to the sector
+    jmraid_close(jmraid);
+    return exit_code;
 }
@@ -0,0 +1,389 @@
+/*
+ * Asynchronous polling of several JMB394 RAID controllers at once, with one
+ * state machine per controller, on the sg v3 write()/read() interface or on
+ * O_DIRECT block I/O through io_uring
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#define _GNU_SOURCE // O_DIRECT
+#include "jm_async.h"
+#include "jm_cmd.h"
+#include "jm_wakeup.h"
+#include "jm_uring.h"
+#include "jm_buf.h"
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/epoll.h>
+
+#define JM_ASYNC_READ_CMD  (0x28)
+#define JM_ASYNC_WRITE_CMD (0x2a)
+
+// Each controller only ever has one exchange in flight, the sector is shared
+// between the command and its response
+enum {
+    JM_ASYNC_SAVE,              // Reading the original sector contents
+    JM_ASYNC_CMD_WRITE,         // Writing probe[probe]
+    JM_ASYNC_CMD_READ,          // Reading its response
+    JM_ASYNC_WAKEUP,            // Writing wakeup sector [step]
+    JM_ASYNC_RESTORE,           // Writing the original sector back
+    JM_ASYNC_DONE
+};
+
+static int JM_Async_SgSubmit( struct jm_async_ctrl* theCtrl, int toDev, void* theBuf ) {
+    sg_io_hdr_t* hdr = &theCtrl->hdr;
+
+    memset( hdr, 0, sizeof(*hdr) );
+    memset( theCtrl->cdb, 0, sizeof(theCtrl->cdb) );
+    theCtrl->cdb[0] = toDev ? JM_ASYNC_WRITE_CMD : JM_ASYNC_READ_CMD;
+    theCtrl->cdb[5] = JM_ASYNC_SECTOR;
+    theCtrl->cdb[8] = 0x01;
+
+    hdr->interface_id = 'S';
+    hdr->cmd_len = sizeof(theCtrl->cdb);
+    hdr->cmdp = theCtrl->cdb;
+    hdr->mx_sb_len = sizeof(theCtrl->sense);
+    hdr->sbp = theCtrl->sense;
+    hdr->dxfer_direction = toDev ? SG_DXFER_TO_DEV : SG_DXFER_FROM_DEV;
+    hdr->dxfer_len = 512;
+    hdr->dxferp = theBuf;
+    hdr->timeout = 3000;
+    hdr->pack_id = theCtrl->packId;
+    hdr->usr_ptr = theCtrl;
+
+    if( write( theCtrl->fd, hdr, sizeof(*hdr) ) < 0 ) {
+        perror( theCtrl->path );
+        return -1;
+    }
+    return 0;
+}
+
+// Queue one sector transfer, on io_uring when theRing is set. With link the
+// next one queued only starts after this one (io_uring only)
+static int JM_Async_Submit( struct jm_uring* theRing, struct jm_async_ctrl* theCtrl, int toDev, void* theBuf, int link ) {
+    int ret;
+
+    theCtrl->packId++;
+    if( theRing ) {
+        ret = JM_Uring_Prep( theRing, toDev, theCtrl->fd, theBuf, 512, (uint64_t)JM_ASYNC_SECTOR * 512,
+                             (uintptr_t)theCtrl, link );
+    } else {
+        ret = JM_Async_SgSubmit( theCtrl, toDev, theBuf );
+    }
+    if( ret == 0 ) {
+        theCtrl->inflight++;
+    }
+    return ret;
+}
+
+// Start the next request(s) for the controller's current state
+static int JM_Async_Next( struct jm_uring* theRing, struct jm_async_ctrl* theCtrl ) {
+    const struct jm_async_probe* probe;
+    struct jm_cmd_template* tmpl;
+
+    switch( theCtrl->state ) {
+    case JM_ASYNC_SAVE:
+        return JM_Async_Submit( theRing, theCtrl, 0, theCtrl->saveBuf, 0 );
+    case JM_ASYNC_CMD_WRITE:
+        probe = &theCtrl->probes[theCtrl->probe];
+        if( !(tmpl = JM_CmdCache_Get( theCtrl->cache, theCtrl->scrambled_cmd, probe->cmd, probe->len )) ) {
+            return -1;
+        }
+        // The template is shared, the sector must survive until completion
+        memcpy( theCtrl->cmdBuf, JM_CmdTemplate_Issue( tmpl, theCtrl->cmdNum++ ), 512 );
+        if( JM_Async_Submit( theRing, theCtrl, 1, theCtrl->cmdBuf, theRing != NULL ) < 0 ) {
+            return -1;
+        }
+        // io_uring gets the read linked right behind the write, one round trip
+        // of the event loop for the whole exchange
+        if( theRing && JM_Async_Submit( theRing, theCtrl, 0, theCtrl->respBuf, 0 ) < 0 ) {
+            return -1;
+        }
+        return 0;
+    case JM_ASYNC_CMD_READ:
+        return JM_Async_Submit( theRing, theCtrl, 0, theCtrl->respBuf, 0 );
+    case JM_ASYNC_WAKEUP:
+        memcpy( theCtrl->cmdBuf, JM_WAKEUP_sectors[theCtrl->step], 512 );
+        return JM_Async_Submit( theRing, theCtrl, 1, theCtrl->cmdBuf, 0 );
+    case JM_ASYNC_RESTORE:
+        return JM_Async_Submit( theRing, theCtrl, 1, theCtrl->saveBuf, 0 );
+    }
+    return 0;
+}
+
+// The request in flight completed (ok or not), move on
+static void JM_Async_Advance( struct jm_async_ctrl* theCtrl, int ok ) {
+    uint32_t res;
+
+    if( !ok ) {
+        theCtrl->error = 1;
+        // Nothing borrowed yet, or nothing more to give back
+        theCtrl->state = theCtrl->state == JM_ASYNC_SAVE || theCtrl->state == JM_ASYNC_RESTORE ?
+            JM_ASYNC_DONE : JM_ASYNC_RESTORE;
+        return;
+    }
+
+    switch( theCtrl->state ) {
+    case JM_ASYNC_SAVE:
+        theCtrl->state = theCtrl->numProbes ? JM_ASYNC_CMD_WRITE : JM_ASYNC_RESTORE;
+        break;
+    case JM_ASYNC_CMD_WRITE:
+        theCtrl->state = JM_ASYNC_CMD_READ;
+        break;
+    case JM_ASYNC_CMD_READ:
+        res = JM_Cmd_Response( theCtrl->cmdBuf, theCtrl->respBuf );
+        // Asleep (or just awake enough to answer garbage): one wakeup, then retry
+        if( res != JM_CMD_OK && !theCtrl->woken ) {
+            theCtrl->woken = 1;
+            theCtrl->step = 0;
+            theCtrl->state = JM_ASYNC_WAKEUP;
+            break;
+        }
+        memcpy( theCtrl->results + theCtrl->probe * 512, theCtrl->respBuf, 512 );
+        theCtrl->status[theCtrl->probe++] = res;
+        theCtrl->state = theCtrl->probe < theCtrl->numProbes ? JM_ASYNC_CMD_WRITE : JM_ASYNC_RESTORE;
+        break;
+    case JM_ASYNC_WAKEUP:
+        if( ++theCtrl->step == JM_WAKEUP_SECTORS ) {
+            theCtrl->state = JM_ASYNC_CMD_WRITE;
+        }
+        break;
+    case JM_ASYNC_RESTORE:
+        theCtrl->state = JM_ASYNC_DONE;
+        break;
+    }
+}
+
+// Keep submitting until a request is in flight or the controller is done
+static void JM_Async_Kick( struct jm_uring* theRing, struct jm_async_ctrl* theCtrl ) {
+    while( !theCtrl->inflight && theCtrl->state != JM_ASYNC_DONE && JM_Async_Next( theRing, theCtrl ) < 0 ) {
+        // Half of a linked pair got queued, carry on once it completes
+        if( theCtrl->inflight ) {
+            break;
+        }
+        JM_Async_Advance( theCtrl, 0 );
+    }
+}
+
+// One request completed. Once a request failed, whatever was linked behind
+// it only comes back cancelled and is dropped
+static void JM_Async_Done( struct jm_uring* theRing, struct jm_async_ctrl* theCtrl, int ok ) {
+    theCtrl->inflight--;
+    if( theCtrl->drain ) {
+        theCtrl->drain--;
+    } else {
+        JM_Async_Advance( theCtrl, ok );
+        if( !ok ) {
+            theCtrl->drain = theCtrl->inflight;
+        }
+    }
+    if( !theCtrl->inflight ) {
+        JM_Async_Kick( theRing, theCtrl );
+    }
+}
+
+static int JM_Async_Open( struct jm_async_ctrl* theCtrl, int transport ) {
+    int k, one = 1;
+
+    if( transport == JM_ASYNC_URING ) {
+        if( (theCtrl->fd = open( theCtrl->path, O_RDWR | O_DIRECT | O_CLOEXEC )) < 0 ) {
+            perror( theCtrl->path );
+            return -1;
+        }
+        return 0;
+    }
+
+    if( (theCtrl->fd = open( theCtrl->path, O_RDWR | O_NONBLOCK | O_CLOEXEC )) < 0 ) {
+        perror( theCtrl->path );
+        return -1;
+    }
+    if( ioctl( theCtrl->fd, SG_GET_VERSION_NUM, &k ) < 0 || k < 30000 ) {
+        fprintf( stderr, "%s is not an sg device, or old sg driver\n", theCtrl->path );
+        close( theCtrl->fd );
+        return -1;
+    }
+    // Have read() hand back exactly the reply to our pack_id
+    ioctl( theCtrl->fd, SG_SET_FORCE_PACK_ID, &one );
+    return 0;
+}
+
+// Fetch a completed sg request, 0 if there was none after all
+static int JM_Async_SgComplete( struct jm_async_ctrl* theCtrl ) {
+    sg_io_hdr_t hdr;
+
+    memset( &hdr, 0, sizeof(hdr) );
+    hdr.interface_id = 'S';
+    hdr.pack_id = theCtrl->packId;
+    if( read( theCtrl->fd, &hdr, sizeof(hdr) ) < 0 ) {
+        if( errno == EAGAIN || errno == EINTR ) {
+            return 0;
+        }
+        perror( theCtrl->path );
+        JM_Async_Done( NULL, theCtrl, 0 );
+        return 1;
+    }
+    if( hdr.pack_id != theCtrl->packId || hdr.usr_ptr != theCtrl ) {
+        // A stale reply, ours is still to come
+        return 0;
+    }
+    JM_Async_Done( NULL, theCtrl, (hdr.info & SG_INFO_OK_MASK) == SG_INFO_OK );
+    return 1;
+}
+
+static void JM_Async_LoopSg( struct jm_async_ctrl* theCtrls, uint32_t numCtrls, uint32_t active ) {
+    struct epoll_event events[16];
+    uint32_t i;
+    int epfd, n;
+
+    if( (epfd = epoll_create1( EPOLL_CLOEXEC )) < 0 ) {
+        perror("epoll_create1");
+        return;
+    }
+    for( i = 0; i < numCtrls; i++ ) {
+        struct epoll_event ev;
+
+        if( theCtrls[i].state == JM_ASYNC_DONE ) {
+            continue;
+        }
+        ev.events = EPOLLIN;
+        ev.data.ptr = &theCtrls[i];
+        epoll_ctl( epfd, EPOLL_CTL_ADD, theCtrls[i].fd, &ev );
+    }
+
+    while( active ) {
+        if( (n = epoll_wait( epfd, events, sizeof(events)/sizeof(events[0]), -1 )) < 0 ) {
+            if( errno == EINTR ) {
+                continue;
+            }
+            perror("epoll_wait");
+            break;
+        }
+        for( i = 0; i < (uint32_t)n; i++ ) {
+            struct jm_async_ctrl* ctrl = events[i].data.ptr;
+
+            if( ctrl->state == JM_ASYNC_DONE || !JM_Async_SgComplete( ctrl ) ) {
+                continue;
+            }
+            if( ctrl->state == JM_ASYNC_DONE && !ctrl->inflight ) {
+                active--;
+            }
+        }
+    }
+    close( epfd );
+}
+
+static void JM_Async_LoopUring( struct jm_uring* theRing, struct jm_async_ctrl* theCtrls, uint32_t numCtrls, uint32_t active ) {
+    struct io_uring_cqe cqe;
+    uint32_t i;
+    int waitNr;
+
+    while( active ) {
+        // No controller moves on before all of its requests (a linked write
+        // and read) completed, so there is no point in waking up any sooner
+        waitNr = 0;
+        for( i = 0; i < numCtrls; i++ ) {
+            if( theCtrls[i].inflight && (!waitNr || theCtrls[i].inflight < waitNr) ) {
+                waitNr = theCtrls[i].inflight;
+            }
+        }
+        // Whatever all controllers queued since the last round goes in with the wait
+        if( JM_Uring_Submit( theRing, waitNr ? waitNr : 1 ) < 0 ) {
+            break;
+        }
+        while( JM_Uring_Reap( theRing, &cqe ) ) {
+            struct jm_async_ctrl* ctrl = (struct jm_async_ctrl*)(uintptr_t)cqe.user_data;
+
+            if( cqe.res < 0 && cqe.res != -ECANCELED ) {
+                fprintf( stderr, "%s: %s\n", ctrl->path, strerror( -cqe.res ) );
+            }
+            JM_Async_Done( theRing, ctrl, cqe.res == 512 );
+            if( ctrl->state == JM_ASYNC_DONE && !ctrl->inflight ) {
+                active--;
+            }
+        }
+    }
+}
+
+int JM_Async_Run( struct jm_async_ctrl* theCtrls, uint32_t numCtrls, int transport ) {
+    static __thread struct jm_cmd_cache cache;
+    struct jm_uring ring;
+    struct jm_uring* theRing = NULL;
+    uint32_t i, active = 0;
+    int failed = 0;
+
+    if( transport == JM_ASYNC_URING ) {
+        // At most a linked write and read per controller queued at any time
+        if( JM_Uring_Init( &ring, numCtrls * 2 < 8 ? 8 : numCtrls * 2 ) < 0 ) {
+            return numCtrls;
+        }
+        theRing = &ring;
+    }
+
+    for( i = 0; i < numCtrls; i++ ) {
+        struct jm_async_ctrl* ctrl = &theCtrls[i];
+
+        memset( ctrl->status, 0, sizeof(ctrl->status) );
+        ctrl->error = 0;
+        ctrl->state = JM_ASYNC_SAVE;
+        ctrl->probe = 0;
+        ctrl->woken = 0;
+        ctrl->packId = 0;
+        ctrl->inflight = 0;
+        ctrl->drain = 0;
+        ctrl->cmdNum = 1;
+        ctrl->cache = &cache;
+        // O_DIRECT wants aligned buffers, the sg driver doesn't mind them
+        ctrl->saveBuf = (uint32_t*)JM_Buf_Get();
+        ctrl->cmdBuf = (uint32_t*)JM_Buf_Get();
+        ctrl->respBuf = (uint32_t*)JM_Buf_Get();
+        if( !ctrl->saveBuf || !ctrl->cmdBuf || !ctrl->respBuf ||
+            ctrl->numProbes > JM_ASYNC_MAX_PROBES || JM_Async_Open( ctrl, transport ) < 0 ) {
+            ctrl->error = 1;
+            ctrl->fd = -1;
+            ctrl->state = JM_ASYNC_DONE;
+            continue;
+        }
+        JM_Async_Kick( theRing, ctrl );
+        if( ctrl->state != JM_ASYNC_DONE || ctrl->inflight ) {
+            active++;
+        }
+    }
+
+    if( theRing ) {
+        JM_Async_LoopUring( theRing, theCtrls, numCtrls, active );
+        JM_Uring_Exit( theRing );
+    } else {
+        JM_Async_LoopSg( theCtrls, numCtrls, active );
+    }
+
+    for( i = 0; i < numCtrls; i++ ) {
+        if( theCtrls[i].fd >= 0 ) {
+            close( theCtrls[i].fd );
+            theCtrls[i].fd = -1;
+        }
+        if( theCtrls[i].state != JM_ASYNC_DONE ) {
+            theCtrls[i].error = 1;
+        }
+        failed += theCtrls[i].error;
+        JM_Buf_Put( (uint8_t*)theCtrls[i].saveBuf );
+        JM_Buf_Put( (uint8_t*)theCtrls[i].cmdBuf );
+        JM_Buf_Put( (uint8_t*)theCtrls[i].respBuf );
+    }
+    return failed;
+}
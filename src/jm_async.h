@@ -0,0 +1,58 @@
+#ifndef JM_ASYNC_H
+#define JM_ASYNC_H
+
+#include <stdint.h>
+#include <scsi/sg.h>
+#include "jm_cmd.h"
+
+// Same borrowed sector as the blocking path, backed up and restored afterwards
+#define JM_ASYNC_SECTOR     (0xfe)
+#define JM_ASYNC_MAX_PROBES (32)
+
+// How the sector is exchanged with the controllers
+#define JM_ASYNC_SG    (0)      // sg v3 write()/read() on /dev/sg<X> (or /dev/sd<X>), over epoll
+#define JM_ASYNC_URING (1)      // O_DIRECT reads and writes on the block device, over io_uring
+
+struct jm_async_probe {
+    const uint8_t* cmd;
+    uint32_t len;
+};
+
+// One controller, driven through save, (wakeup,) commands and restore.
+// The caller fills in the first block, JM_Async_Run() does the rest
+struct jm_async_ctrl {
+    const char* path;
+    uint32_t scrambled_cmd;
+    const struct jm_async_probe* probes;
+    uint32_t numProbes;
+    uint8_t* results;           // numProbes sectors, the response to probe i at i*512
+
+    // Outcome
+    int error;                  // Nonzero if the device could not be polled
+    uint32_t status[JM_ASYNC_MAX_PROBES]; // JM_CMD_* for each probe
+
+    // Private
+    int fd;
+    int state;
+    uint32_t probe;
+    uint32_t step;
+    int woken;
+    int packId;                 // Of the last request submitted
+    int inflight;
+    int drain;                  // Cancelled completions still to come after a failure
+    uint32_t cmdNum;
+    struct jm_cmd_cache* cache; // Shared by all controllers of a run
+    sg_io_hdr_t hdr;
+    uint8_t cdb[10];
+    uint8_t sense[32];
+    uint32_t* saveBuf;          // Sector sized and aligned for O_DIRECT
+    uint32_t* cmdBuf;
+    uint32_t* respBuf;
+};
+
+// Poll all controllers at once, multiplexing the devices over epoll (or
+// batching them into one io_uring) so the total time is that of the slowest
+// one. Returns the number of controllers that failed
+int JM_Async_Run( struct jm_async_ctrl* theCtrls, uint32_t numCtrls, int transport );
+
+#endif
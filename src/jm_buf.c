@@ -0,0 +1,63 @@
+/*
+ * Pool of aligned sector buffers, so polling does not allocate per command
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include "jm_buf.h"
+#include <stdlib.h>
+
+// Free buffers beyond this many go back to the heap
+#define JM_BUF_FREE_MAX (4 * JM_BUF_POOL)
+
+// One page per slot, the alignment of the array alone is only the first one's
+static uint8_t bufPool[JM_BUF_POOL][JM_BUF_ALIGN] __attribute__((aligned(JM_BUF_ALIGN)));
+static __thread uint8_t* bufFree[JM_BUF_FREE_MAX];
+static __thread uint32_t bufNumFree;
+static uint32_t bufPoolUsed;    // Static buffers handed out at least once
+static unsigned long bufAllocs;
+
+uint8_t* JM_Buf_Get( void ) {
+    void* theBuf;
+    uint32_t i;
+
+    if( bufNumFree ) {
+        return bufFree[--bufNumFree];
+    }
+    if( __atomic_load_n( &bufPoolUsed, __ATOMIC_RELAXED ) < JM_BUF_POOL &&
+        (i = __atomic_fetch_add( &bufPoolUsed, 1, __ATOMIC_RELAXED )) < JM_BUF_POOL ) {
+        return bufPool[i];
+    }
+    if( posix_memalign( &theBuf, JM_BUF_ALIGN, JM_BUF_SIZE ) ) {
+        return NULL;
+    }
+    __atomic_fetch_add( &bufAllocs, 1, __ATOMIC_RELAXED );
+    return theBuf;
+}
+
+void JM_Buf_Put( uint8_t* theBuf ) {
+    if( !theBuf ) {
+        return;
+    }
+    if( bufNumFree < JM_BUF_FREE_MAX ) {
+        bufFree[bufNumFree++] = theBuf;
+    } else if( theBuf < bufPool[0] || theBuf > bufPool[JM_BUF_POOL-1] ) {
+        free( theBuf );
+    }
+}
+
+unsigned long JM_Buf_Allocs( void ) {
+    return __atomic_load_n( &bufAllocs, __ATOMIC_RELAXED );
+}
@@ -0,0 +1,20 @@
+#ifndef JM_BUF_H
+#define JM_BUF_H
+
+#include <stdint.h>
+
+#define JM_BUF_SIZE  (512)
+#define JM_BUF_POOL  (32)       // Preallocated, enough for the async engine with ten controllers
+#define JM_BUF_ALIGN (4096)     // Every buffer starts on a page of its own
+
+// Sector buffers, page aligned so they also suit O_DIRECT. They come from a
+// static pool, the heap is only touched once more are in use at the same
+// time, and those stay around for reuse. Safe to use from several threads,
+// without locking: freed buffers go to a per-thread list
+uint8_t* JM_Buf_Get( void );
+void JM_Buf_Put( uint8_t* theBuf );
+
+// Number of heap allocations made so far, constant once the pool is warm
+unsigned long JM_Buf_Allocs( void );
+
+#endif
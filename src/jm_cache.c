@@ -0,0 +1,187 @@
+/*
+ * On-disk cache of the controller responses that practically never change
+ * (chip info, identity of the disks), so unchanged runs can skip them
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include "jm_cache.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+void JM_Cache_Init( struct jm_cache* theCache, uint32_t scrambled_cmd ) {
+    memset( theCache, 0, sizeof(*theCache) );
+    theCache->magic = JM_CACHE_MAGIC;
+    theCache->version = JM_CACHE_VERSION;
+    theCache->size = sizeof(*theCache);
+    theCache->scrambled_cmd = scrambled_cmd;
+}
+
+// The first line of a sysfs file, 0 or -1
+static int JM_Cache_Read_Line( const char* thePath, char* theLine, size_t theSize ) {
+    ssize_t len;
+    int fd;
+
+    if( (fd = open( thePath, O_RDONLY | O_CLOEXEC )) < 0 ) {
+        return -1;
+    }
+    len = read( fd, theLine, theSize - 1 );
+    close( fd );
+    if( len <= 0 ) {
+        return -1;
+    }
+    theLine[len] = 0;
+    theLine[strcspn( theLine, "\n" )] = 0;
+    return theLine[0] ? 0 : -1;
+}
+
+void JM_Cache_Device( const char* theDevice, char* theIdent, size_t theSize ) {
+    static const char* const classes[] = { "block", "scsi_generic" };
+    char path[512], line[256];
+    char* real, *sys;
+    const char* name;
+    size_t i;
+
+    // /dev/disk/by-id/... links to the node
+    if( !(real = realpath( theDevice, NULL )) ) {
+        snprintf( theIdent, theSize, "path:%s", theDevice );
+        return;
+    }
+    name = strrchr( real, '/' ) ? strrchr( real, '/' ) + 1 : real;
+    for( i = 0; i < sizeof(classes) / sizeof(classes[0]); i++ ) {
+        snprintf( path, sizeof(path), "/sys/class/%s/%s/device/wwid", classes[i], name );
+        if( JM_Cache_Read_Line( path, line, sizeof(line) ) == 0 ) {
+            snprintf( theIdent, theSize, "wwid:%s", line );
+            free( real );
+            return;
+        }
+        snprintf( path, sizeof(path), "/sys/class/%s/%s/device", classes[i], name );
+        if( (sys = realpath( path, NULL )) ) {
+            snprintf( theIdent, theSize, "sysfs:%s", sys );
+            free( sys );
+            free( real );
+            return;
+        }
+    }
+    snprintf( theIdent, theSize, "path:%s", real );
+    free( real );
+}
+
+// An empty cache for theIdent, in place of a file that cannot be used
+static int JM_Cache_Empty( struct jm_cache* theCache, uint32_t scrambled_cmd, const char* theIdent ) {
+    JM_Cache_Init( theCache, scrambled_cmd );
+    snprintf( theCache->device, sizeof(theCache->device), "%s", theIdent );
+    return -1;
+}
+
+int JM_Cache_Load( const char* thePath, uint32_t scrambled_cmd, const char* theIdent, struct jm_cache* theCache ) {
+    int fd;
+    ssize_t len;
+    int i;
+
+    if( (fd = open( thePath, O_RDONLY | O_CLOEXEC )) < 0 ) {
+        return JM_Cache_Empty( theCache, scrambled_cmd, theIdent );
+    }
+    len = read( fd, theCache, sizeof(*theCache) );
+    close( fd );
+
+    theCache->device[sizeof(theCache->device) - 1] = 0;
+    if( len != sizeof(*theCache) || theCache->magic != JM_CACHE_MAGIC || theCache->version != JM_CACHE_VERSION ||
+        theCache->size != sizeof(*theCache) || theCache->scrambled_cmd != scrambled_cmd ||
+        strncmp( theCache->device, theIdent, sizeof(theCache->device) - 1 ) != 0 ) {
+        return JM_Cache_Empty( theCache, scrambled_cmd, theIdent );
+    }
+    // Names and keys are compared as strings
+    for( i = 0; i < JM_CACHE_ENTRIES; i++ ) {
+        theCache->entry[i].name[sizeof(theCache->entry[i].name) - 1] = 0;
+        theCache->entry[i].key[sizeof(theCache->entry[i].key) - 1] = 0;
+    }
+    return 0;
+}
+
+int JM_Cache_Save( const char* thePath, const struct jm_cache* theCache ) {
+    char tmpPath[4096];
+    int fd;
+
+    // Written next to it and renamed over it, so a reader (or a crash) never
+    // sees half a cache
+    if( snprintf( tmpPath, sizeof(tmpPath), "%s.tmp", thePath ) >= (int)sizeof(tmpPath) ) {
+        return -1;
+    }
+    if( (fd = open( tmpPath, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644 )) < 0 ) {
+        perror( tmpPath );
+        return -1;
+    }
+    if( write( fd, theCache, sizeof(*theCache) ) != sizeof(*theCache) ) {
+        perror( tmpPath );
+        close( fd );
+        unlink( tmpPath );
+        return -1;
+    }
+    close( fd );
+    if( rename( tmpPath, thePath ) < 0 ) {
+        perror( thePath );
+        unlink( tmpPath );
+        return -1;
+    }
+    return 0;
+}
+
+static struct jm_cache_entry* JM_Cache_Slot( struct jm_cache* theCache, const char* theName ) {
+    int i;
+
+    for( i = 0; i < JM_CACHE_ENTRIES; i++ ) {
+        if( strcmp( theCache->entry[i].name, theName ) == 0 ) {
+            return &theCache->entry[i];
+        }
+    }
+    return NULL;
+}
+
+const struct jm_cache_entry* JM_Cache_Find( const struct jm_cache* theCache, const char* theName ) {
+    return JM_Cache_Slot( (struct jm_cache*)theCache, theName );
+}
+
+const uint8_t* JM_Cache_Get( const struct jm_cache* theCache, const char* theName, const char* theKey, uint32_t ttl ) {
+    const struct jm_cache_entry* theEntry = JM_Cache_Find( theCache, theName );
+    uint64_t now = time( NULL );
+
+    if( !theEntry || strcmp( theEntry->key, theKey ) != 0 ) {
+        return NULL;
+    }
+    // A clock that went backwards makes it stale as well
+    if( theEntry->stored > now || now - theEntry->stored >= ttl ) {
+        return NULL;
+    }
+    return theEntry->response;
+}
+
+void JM_Cache_Put( struct jm_cache* theCache, const char* theName, const char* theKey, const uint8_t* theResponse ) {
+    struct jm_cache_entry* theEntry = JM_Cache_Slot( theCache, theName );
+
+    if( !theEntry && !(theEntry = JM_Cache_Slot( theCache, "" )) ) {
+        // Full, only happens with more cached queries than slots
+        theEntry = &theCache->entry[0];
+    }
+    memset( theEntry, 0, sizeof(*theEntry) );
+    snprintf( theEntry->name, sizeof(theEntry->name), "%s", theName );
+    snprintf( theEntry->key, sizeof(theEntry->key), "%s", theKey );
+    theEntry->stored = time( NULL );
+    memcpy( theEntry->response, theResponse, sizeof(theEntry->response) );
+}
@@ -0,0 +1,57 @@
+#ifndef JM_CACHE_H
+#define JM_CACHE_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define JM_CACHE_MAGIC   (0x4a4d4348) // "JMCH"
+#define JM_CACHE_VERSION (4)
+#define JM_CACHE_ENTRIES (32)
+#define JM_CACHE_KEY     (0x40)
+#define JM_CACHE_DEVICE  (0x80)
+
+// One response sector, as returned for a query while theKey was current
+struct jm_cache_entry {
+    char name[8];               // Query name, empty if the slot is unused
+    char key[JM_CACHE_KEY];     // What the response belongs to (serial numbers)
+    uint64_t stored;            // time() when it was read from the controller
+    uint8_t response[512];
+};
+
+// The whole cache file
+struct jm_cache {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t size;              // sizeof(struct jm_cache) of the writer
+    uint32_t scrambled_cmd;     // Controller type it was filled from
+    char device[JM_CACHE_DEVICE]; // And which controller, see JM_Cache_Device()
+    struct jm_cache_entry entry[JM_CACHE_ENTRIES];
+};
+
+// An empty cache, e.g. one that only lives in memory
+void JM_Cache_Init( struct jm_cache* theCache, uint32_t scrambled_cmd );
+
+// Which controller theDevice (/dev/sdX, /dev/sgN) is, known before sending
+// it anything: its WWID from sysfs, or failing that its SCSI device path
+// (bus, port, host, target and LUN), or the device path itself
+void JM_Cache_Device( const char* theDevice, char* theIdent, size_t theSize );
+
+// Reads thePath into theCache. A missing, damaged or foreign file (another
+// controller type, or another controller than theIdent) leaves an empty
+// cache for theIdent and returns -1
+int JM_Cache_Load( const char* thePath, uint32_t scrambled_cmd, const char* theIdent, struct jm_cache* theCache );
+
+// Writes the cache back, replacing the file in one go. Returns 0 or -1
+int JM_Cache_Save( const char* thePath, const struct jm_cache* theCache );
+
+// The entry for theName whatever its key and age, NULL if there is none
+const struct jm_cache_entry* JM_Cache_Find( const struct jm_cache* theCache, const char* theName );
+
+// The response stored for theName under theKey, if it is less than ttl
+// seconds old (so never with a ttl of 0), otherwise NULL
+const uint8_t* JM_Cache_Get( const struct jm_cache* theCache, const char* theName, const char* theKey, uint32_t ttl );
+
+// Stores (or replaces) the response for theName
+void JM_Cache_Put( struct jm_cache* theCache, const char* theName, const char* theKey, const uint8_t* theResponse );
+
+#endif
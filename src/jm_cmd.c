@@ -0,0 +1,112 @@
+/*
+ * Pre-encoded command sectors for the JMB394 RAID controller
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include "jm_cmd.h"
+#include "jm_crc.h"
+#include "sata_xor.h"
+#include <string.h>
+#include <asm/byteorder.h> // __cpu_to_le32 etc.
+
+// The CRC is linear, so the command number only adds n * x^(32*126) mod P to
+// the CRC of the command with a zero there (dword 1 of the 0x7f CRC:d ones).
+// cmdNumLUT[k][b] is that contribution for byte k of n being b
+static uint32_t cmdNumLUT[4][256];
+
+__attribute__((constructor))
+static void JM_Cmd_Init( void ) {
+    uint32_t shift = JM_CRC_XPow( 32 * 126 );
+    uint32_t k, b;
+
+    for( k = 0; k < 4; k++ ) {
+        for( b = 0; b < 256; b++ ) {
+            cmdNumLUT[k][b] = JM_CRC_MulMod( b << (8*k), shift );
+        }
+    }
+}
+
+void JM_CmdTemplate_Init( struct jm_cmd_template* theTemplate, uint32_t scrambled_cmd, const uint8_t* theCmd, uint32_t theLen ) {
+    uint8_t* sector8 = (uint8_t*)theTemplate->sector;
+
+    // Entire sector is always sent, so zero fill cmd
+    memset( theTemplate->sector, 0, sizeof(theTemplate->sector) );
+    memcpy( sector8+0x08, theCmd, theLen );
+    theTemplate->sector[0] = __cpu_to_le32( scrambled_cmd );
+
+    theTemplate->baseCRC = JM_CRC_Scramble( JM_CRC_INIT, theTemplate->sector, SATA_XOR_scramblerdata, 0x7f );
+    theTemplate->scrambled_cmd = scrambled_cmd;
+    theTemplate->len = theLen;
+    memcpy( theTemplate->cmd, theCmd, theLen );
+}
+
+uint32_t* JM_CmdTemplate_Issue( struct jm_cmd_template* theTemplate, uint32_t cmdNum ) {
+    uint32_t myCRC = theTemplate->baseCRC ^
+        cmdNumLUT[0][ cmdNum&0xff ] ^ cmdNumLUT[1][ (cmdNum>>8)&0xff ] ^
+        cmdNumLUT[2][ (cmdNum>>16)&0xff ] ^ cmdNumLUT[3][ cmdNum>>24 ];
+
+    theTemplate->sector[1] = __cpu_to_le32( cmdNum ) ^ SATA_XOR_scramblerdata[1];
+    theTemplate->sector[0x7f] = __cpu_to_le32( myCRC ) ^ SATA_XOR_scramblerdata[0x7f];
+    return theTemplate->sector;
+}
+
+struct jm_cmd_template* JM_CmdCache_Get( struct jm_cmd_cache* theCache, uint32_t scrambled_cmd, const uint8_t* theCmd, uint32_t theLen ) {
+    struct jm_cmd_template* theTemplate;
+    uint32_t i;
+
+    if( theLen > sizeof(theTemplate->cmd) ) {
+        return NULL;
+    }
+    for( i = 0; i < theCache->used; i++ ) {
+        theTemplate = &theCache->entries[i];
+        if( theTemplate->scrambled_cmd == scrambled_cmd && theTemplate->len == theLen &&
+            memcmp( theTemplate->cmd, theCmd, theLen ) == 0 ) {
+            return theTemplate;
+        }
+    }
+
+    // Not seen before, take a free slot or recycle the oldest one
+    if( theCache->used < JM_CMDCACHE_SIZE ) {
+        theTemplate = &theCache->entries[theCache->used++];
+    } else {
+        theTemplate = &theCache->entries[theCache->next];
+        theCache->next = (theCache->next + 1) % JM_CMDCACHE_SIZE;
+    }
+    JM_CmdTemplate_Init( theTemplate, scrambled_cmd, theCmd, theLen );
+    return theTemplate;
+}
+
+int JM_Cmd_IsEcho( const uint32_t* theCmd, const uint32_t* theResp ) {
+    uint32_t i;
+
+    for( i = 0; i < 512/4; i++ ) {
+        if( (theResp[i] ^ SATA_XOR_scramblerdata[i]) != theCmd[i] ) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+uint32_t JM_Cmd_Response( const uint32_t* theCmd, uint32_t* theResp ) {
+    if( SATA_XOR_Decode( theResp ) != __le32_to_cpu( theResp[0x7f] ) ) {
+        return JM_CMD_BADCRC;
+    }
+    return JM_Cmd_IsEcho( theCmd, theResp ) ? JM_CMD_ASLEEP : JM_CMD_OK;
+}
+
+uint32_t JM_Cmd_Fingerprint( uint32_t crcRem, const uint32_t* theResp ) {
+    return JM_CRC_Update( crcRem, theResp + JM_CMD_PAYLOAD/4, 0x7f - JM_CMD_PAYLOAD/4 );
+}
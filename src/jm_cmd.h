@@ -0,0 +1,54 @@
+#ifndef JM_CMD_H
+#define JM_CMD_H
+
+#include <stdint.h>
+
+// Outcome of a command
+#define JM_CMD_OK     (0)
+#define JM_CMD_BADCRC (1)
+#define JM_CMD_ASLEEP (2) // Got our own command back, the controller needs a wakeup
+#define JM_CMD_IOERR  (3) // The exchange itself failed
+
+// Where the answer starts in a decoded response sector
+#define JM_CMD_PAYLOAD (0x10 - 0x04)
+
+// A scrambled command sector that only needs its command number (dword 1)
+// and CRC (dword 0x7f) patched in before it can be sent
+struct jm_cmd_template {
+    uint32_t sector[512/4];
+    uint32_t baseCRC;           // CRC of the command with command number 0
+    uint32_t scrambled_cmd;
+    uint32_t len;
+    uint8_t cmd[512-0x08];
+};
+
+void JM_CmdTemplate_Init( struct jm_cmd_template* theTemplate, uint32_t scrambled_cmd, const uint8_t* theCmd, uint32_t theLen );
+
+// Ready the template for sending as command number cmdNum, returning the sector to write
+uint32_t* JM_CmdTemplate_Issue( struct jm_cmd_template* theTemplate, uint32_t cmdNum );
+
+#define JM_CMDCACHE_SIZE (16)
+
+// Recently used templates. Each device context (or thread) keeps its own,
+// as issuing a command patches the template. Zero filled is empty
+struct jm_cmd_cache {
+    struct jm_cmd_template entries[JM_CMDCACHE_SIZE];
+    uint32_t used;
+    uint32_t next;              // Oldest entry, recycled next once all are used
+};
+
+// Template for the command, encoded on first use and reused afterwards
+struct jm_cmd_template* JM_CmdCache_Get( struct jm_cmd_cache* theCache, uint32_t scrambled_cmd, const uint8_t* theCmd, uint32_t theLen );
+
+// A controller that is still asleep just stores the command sector like any
+// disk would, so reading it back gives the (valid) command instead of a response
+int JM_Cmd_IsEcho( const uint32_t* theCmd, const uint32_t* theResp );
+
+// Descramble the response read back after sending theCmd, returning JM_CMD_*
+uint32_t JM_Cmd_Response( const uint32_t* theCmd, uint32_t* theResp );
+
+// CRC of the payload of a decoded response. Leaves out the CRC the controller
+// sent along, which changes with the command number even if the answer does not
+uint32_t JM_Cmd_Fingerprint( uint32_t crcRem, const uint32_t* theResp );
+
+#endif
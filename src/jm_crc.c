@@ -18,8 +18,15 @@
  */
 
 #include "jm_crc.h"
+#include <stddef.h>
+#include <string.h>
 #include <asm/byteorder.h> // __be32_to_cpu etc.
 
+#if defined(__x86_64__) || defined(__i386__)
+#define JM_CRC_HAVE_PCLMUL
+#include <immintrin.h>
+#endif
+
 // Standard CRC-32 LUT for polynomial 0x04c11db7
 const uint32_t crcLUT[256] = { \
     0x00000000, 0x04c11db7, 0x09823b6e, 0x0d4326d9, 0x130476dc, 0x17c56b6b, 0x1a864db2, 0x1e475005, \
@@ -55,10 +62,16 @@ const uint32_t crcLUT[256] = { \
     0x89b8fd09, 0x8d79e0be, 0x803ac667, 0x84fbdbd0, 0x9abc8bd5, 0x9e7d9662, 0x933eb0bb, 0x97ffad0c, \
     0xafb010b1, 0xab710d06, 0xa6322bdf, 0xa2f33668, 0xbcb4666d, 0xb8757bda, 0xb5365d03, 0xb1f740b4 };
 
-uint32_t JM_CRC( uint32_t* theData, uint32_t numDwords ) {
-    // Unusual initial remainder?
-    uint32_t crcRem = 0x52325032;
+// crcSliceLUT[n][b] is the CRC (zero initial remainder) of byte b followed by n zero bytes,
+// crcSliceLUT[0] being identical to crcLUT above. Filled in by JM_CRC_Init()
+uint32_t crcSliceLUT[16][256];
+
+// Folding constants x^(d+64) mod P and x^d mod P for a fold distance of d bits
+static uint64_t crcFold128[2], crcFold256[2], crcFold384[2], crcFold512[2];
+
+typedef uint32_t (*JM_CRC_Fn)( uint32_t crcRem, const uint32_t* theData, uint32_t numDwords );
 
+static uint32_t JM_CRC_Scalar( uint32_t crcRem, const uint32_t* theData, uint32_t numDwords ) {
     uint32_t i;
 
     // One 32-bit word at a time CRC:d in NETWORK order without any reflection
@@ -69,8 +82,375 @@ uint32_t JM_CRC( uint32_t* theData, uint32_t numDwords ) {
         crcRem = crcLUT[ ((dw>>16)&0xff)^ (crcRem >> 24) ] ^ (crcRem << 8);
         crcRem = crcLUT[ (dw>>24)       ^ (crcRem >> 24) ] ^ (crcRem << 8);
     }
+    return crcRem;
+}
+
+// What the fused kernels do with the key stream while CRC:ing
+#define JM_CRC_PLAIN      0 // No key, data is left untouched
+#define JM_CRC_SCRAMBLE   1 // CRC the data as it is, then xor the key into it
+#define JM_CRC_DESCRAMBLE 2 // xor the key into the data, then CRC the result
+
+// Fetch dword i for the CRC as a little endian value, (de)scrambling it on the way
+static inline __attribute__((always_inline))
+uint32_t JM_CRC_Get( uint32_t* theData, const uint32_t* theKey, uint32_t i, int mode ) {
+    uint32_t dw = theData[i];
+
+    if( mode != JM_CRC_PLAIN ) {
+        theData[i] = dw ^ theKey[i];
+        if( mode == JM_CRC_DESCRAMBLE ) {
+            dw ^= theKey[i];
+        }
+    }
+    return __le32_to_cpu( dw );
+}
+
+// Feeding the byte-swapped dword LSB first is the same as feeding the little
+// endian dword MSB first, so the remainder can simply be xor:ed in
+static inline __attribute__((always_inline))
+uint32_t JM_CRC_Slice8_X( uint32_t crcRem, uint32_t* theData, const uint32_t* theKey, uint32_t numDwords, int mode ) {
+    while( numDwords >= 2 ) {
+        uint32_t x = crcRem ^ JM_CRC_Get( theData, theKey, 0, mode );
+        uint32_t y = JM_CRC_Get( theData, theKey, 1, mode );
+        crcRem = crcSliceLUT[7][ x>>24 ] ^ crcSliceLUT[6][ (x>>16)&0xff ] ^
+                 crcSliceLUT[5][ (x>>8)&0xff ] ^ crcSliceLUT[4][ x&0xff ] ^
+                 crcSliceLUT[3][ y>>24 ] ^ crcSliceLUT[2][ (y>>16)&0xff ] ^
+                 crcSliceLUT[1][ (y>>8)&0xff ] ^ crcSliceLUT[0][ y&0xff ];
+        theData += 2;
+        theKey += (mode != JM_CRC_PLAIN) ? 2 : 0;
+        numDwords -= 2;
+    }
+    if( numDwords ) {
+        uint32_t x = crcRem ^ JM_CRC_Get( theData, theKey, 0, mode );
+        crcRem = crcSliceLUT[3][ x>>24 ] ^ crcSliceLUT[2][ (x>>16)&0xff ] ^
+                 crcSliceLUT[1][ (x>>8)&0xff ] ^ crcSliceLUT[0][ x&0xff ];
+    }
+    return crcRem;
+}
+
+static inline __attribute__((always_inline))
+uint32_t JM_CRC_Slice16_X( uint32_t crcRem, uint32_t* theData, const uint32_t* theKey, uint32_t numDwords, int mode ) {
+    while( numDwords >= 4 ) {
+        uint32_t w = crcRem ^ JM_CRC_Get( theData, theKey, 0, mode );
+        uint32_t x = JM_CRC_Get( theData, theKey, 1, mode );
+        uint32_t y = JM_CRC_Get( theData, theKey, 2, mode );
+        uint32_t z = JM_CRC_Get( theData, theKey, 3, mode );
+        crcRem = crcSliceLUT[15][ w>>24 ] ^ crcSliceLUT[14][ (w>>16)&0xff ] ^
+                 crcSliceLUT[13][ (w>>8)&0xff ] ^ crcSliceLUT[12][ w&0xff ] ^
+                 crcSliceLUT[11][ x>>24 ] ^ crcSliceLUT[10][ (x>>16)&0xff ] ^
+                 crcSliceLUT[9][ (x>>8)&0xff ] ^ crcSliceLUT[8][ x&0xff ] ^
+                 crcSliceLUT[7][ y>>24 ] ^ crcSliceLUT[6][ (y>>16)&0xff ] ^
+                 crcSliceLUT[5][ (y>>8)&0xff ] ^ crcSliceLUT[4][ y&0xff ] ^
+                 crcSliceLUT[3][ z>>24 ] ^ crcSliceLUT[2][ (z>>16)&0xff ] ^
+                 crcSliceLUT[1][ (z>>8)&0xff ] ^ crcSliceLUT[0][ z&0xff ];
+        theData += 4;
+        theKey += (mode != JM_CRC_PLAIN) ? 4 : 0;
+        numDwords -= 4;
+    }
+    return JM_CRC_Slice8_X( crcRem, theData, theKey, numDwords, mode );
+}
+
+static uint32_t JM_CRC_Slice8( uint32_t crcRem, const uint32_t* theData, uint32_t numDwords ) {
+    return JM_CRC_Slice8_X( crcRem, (uint32_t*)theData, NULL, numDwords, JM_CRC_PLAIN );
+}
+
+static uint32_t JM_CRC_Slice8_Scramble( uint32_t crcRem, uint32_t* theData, const uint32_t* theKey, uint32_t numDwords ) {
+    return JM_CRC_Slice8_X( crcRem, theData, theKey, numDwords, JM_CRC_SCRAMBLE );
+}
+
+static uint32_t JM_CRC_Slice8_Descramble( uint32_t crcRem, uint32_t* theData, const uint32_t* theKey, uint32_t numDwords ) {
+    return JM_CRC_Slice8_X( crcRem, theData, theKey, numDwords, JM_CRC_DESCRAMBLE );
+}
+
+static uint32_t JM_CRC_Slice16( uint32_t crcRem, const uint32_t* theData, uint32_t numDwords ) {
+    return JM_CRC_Slice16_X( crcRem, (uint32_t*)theData, NULL, numDwords, JM_CRC_PLAIN );
+}
+
+// The key stream on its own, a loop the compiler vectorizes
+static void JM_CRC_Xor( uint32_t* theData, const uint32_t* theKey, uint32_t numDwords ) {
+    uint32_t i;
+
+    for( i = 0; i < numDwords; i++ ) {
+        theData[i] ^= theKey[i];
+    }
+}
+
+// Slice-by-16 is bound by its 16 table loads per 16 bytes, fusing the key
+// loads and stores into that loop only adds to it. A separate xor pass is
+// faster (see tests/sata_xor_bench.c), so it keeps two passes
+static uint32_t JM_CRC_Slice16_Scramble( uint32_t crcRem, uint32_t* theData, const uint32_t* theKey, uint32_t numDwords ) {
+    crcRem = JM_CRC_Slice16( crcRem, theData, numDwords );
+    JM_CRC_Xor( theData, theKey, numDwords );
+    return crcRem;
+}
+
+static uint32_t JM_CRC_Slice16_Descramble( uint32_t crcRem, uint32_t* theData, const uint32_t* theKey, uint32_t numDwords ) {
+    JM_CRC_Xor( theData, theKey, numDwords );
+    return JM_CRC_Slice16( crcRem, theData, numDwords );
+}
 
-    // No reflection or final xor of the result
+// The byte-at-a-time engine is only there as a reference, so it gets no fused variant
+static uint32_t JM_CRC_Scalar_Scramble( uint32_t crcRem, uint32_t* theData, const uint32_t* theKey, uint32_t numDwords ) {
+    crcRem = JM_CRC_Scalar( crcRem, theData, numDwords );
+    JM_CRC_Xor( theData, theKey, numDwords );
     return crcRem;
 }
 
+static uint32_t JM_CRC_Scalar_Descramble( uint32_t crcRem, uint32_t* theData, const uint32_t* theKey, uint32_t numDwords ) {
+    JM_CRC_Xor( theData, theKey, numDwords );
+    return JM_CRC_Scalar( crcRem, theData, numDwords );
+}
+
+#ifdef JM_CRC_HAVE_PCLMUL
+// 128 bits of message as one polynomial, first dword in the top 32 bits,
+// (de)scrambling the data in memory on the way
+__attribute__((target("pclmul,sse2"), always_inline))
+static inline __m128i JM_CRC_Load128( uint32_t* theData, const uint32_t* theKey, int mode ) {
+    __m128i dw = _mm_loadu_si128( (const __m128i*)theData );
+
+    if( mode != JM_CRC_PLAIN ) {
+        __m128i out = _mm_xor_si128( dw, _mm_loadu_si128( (const __m128i*)theKey ) );
+        _mm_storeu_si128( (__m128i*)theData, out );
+        if( mode == JM_CRC_DESCRAMBLE ) {
+            dw = out;
+        }
+    }
+    return _mm_shuffle_epi32( dw, 0x1b );
+}
+
+// Move the 128-bit polynomial acc d bits further down the message
+__attribute__((target("pclmul,sse2"), always_inline))
+static inline __m128i JM_CRC_Fold( __m128i acc, __m128i k ) {
+    return _mm_xor_si128( _mm_clmulepi64_si128( acc, k, 0x11 ),
+                          _mm_clmulepi64_si128( acc, k, 0x00 ) );
+}
+
+// Carry-less multiply folding of 128 bit blocks (four in parallel while the
+// buffer allows), leaving the final reduction to the tables
+__attribute__((target("pclmul,sse2"), always_inline))
+static inline uint32_t JM_CRC_PCLMUL_X( uint32_t crcRem, uint32_t* theData, const uint32_t* theKey, uint32_t numDwords, int mode ) {
+    __m128i k128 = _mm_set_epi64x( crcFold128[0], crcFold128[1] );
+    __m128i acc;
+    uint32_t tmp[4];
+    uint32_t keyStep = (mode != JM_CRC_PLAIN) ? 4 : 0;
+
+    if( numDwords < 8 ) {
+        return JM_CRC_Slice16_X( crcRem, theData, theKey, numDwords, mode );
+    }
+
+    // The initial remainder goes into the first 32 bits of the message
+    acc = _mm_xor_si128( JM_CRC_Load128( theData, theKey, mode ), _mm_set_epi32( crcRem, 0, 0, 0 ) );
+    theData += 4;
+    theKey += keyStep;
+    numDwords -= 4;
+
+    if( numDwords >= 28 ) {
+        __m128i k512 = _mm_set_epi64x( crcFold512[0], crcFold512[1] );
+        __m128i k384 = _mm_set_epi64x( crcFold384[0], crcFold384[1] );
+        __m128i k256 = _mm_set_epi64x( crcFold256[0], crcFold256[1] );
+        __m128i acc1 = JM_CRC_Load128( theData, theKey, mode );
+        __m128i acc2 = JM_CRC_Load128( theData + 4, theKey + keyStep, mode );
+        __m128i acc3 = JM_CRC_Load128( theData + 8, theKey + 2*keyStep, mode );
+        theData += 12;
+        theKey += 3*keyStep;
+        numDwords -= 12;
+
+        while( numDwords >= 16 ) {
+            acc  = _mm_xor_si128( JM_CRC_Fold( acc,  k512 ), JM_CRC_Load128( theData, theKey, mode ) );
+            acc1 = _mm_xor_si128( JM_CRC_Fold( acc1, k512 ), JM_CRC_Load128( theData + 4, theKey + keyStep, mode ) );
+            acc2 = _mm_xor_si128( JM_CRC_Fold( acc2, k512 ), JM_CRC_Load128( theData + 8, theKey + 2*keyStep, mode ) );
+            acc3 = _mm_xor_si128( JM_CRC_Fold( acc3, k512 ), JM_CRC_Load128( theData + 12, theKey + 3*keyStep, mode ) );
+            theData += 16;
+            theKey += 4*keyStep;
+            numDwords -= 16;
+        }
+        acc = _mm_xor_si128( _mm_xor_si128( JM_CRC_Fold( acc, k384 ), JM_CRC_Fold( acc1, k256 ) ),
+                             _mm_xor_si128( JM_CRC_Fold( acc2, k128 ), acc3 ) );
+    }
+
+    while( numDwords >= 4 ) {
+        acc = _mm_xor_si128( JM_CRC_Fold( acc, k128 ), JM_CRC_Load128( theData, theKey, mode ) );
+        theData += 4;
+        theKey += keyStep;
+        numDwords -= 4;
+    }
+
+    // acc * x^32 mod P is just the CRC of acc with a zero initial remainder
+    _mm_storeu_si128( (__m128i*)tmp, _mm_shuffle_epi32( acc, 0x1b ) );
+    crcRem = JM_CRC_Slice16( 0, tmp, 4 );
+
+    return JM_CRC_Slice8_X( crcRem, theData, theKey, numDwords, mode );
+}
+
+__attribute__((target("pclmul,sse2")))
+static uint32_t JM_CRC_PCLMUL( uint32_t crcRem, const uint32_t* theData, uint32_t numDwords ) {
+    return JM_CRC_PCLMUL_X( crcRem, (uint32_t*)theData, NULL, numDwords, JM_CRC_PLAIN );
+}
+
+__attribute__((target("pclmul,sse2")))
+static uint32_t JM_CRC_PCLMUL_Scramble( uint32_t crcRem, uint32_t* theData, const uint32_t* theKey, uint32_t numDwords ) {
+    return JM_CRC_PCLMUL_X( crcRem, theData, theKey, numDwords, JM_CRC_SCRAMBLE );
+}
+
+__attribute__((target("pclmul,sse2")))
+static uint32_t JM_CRC_PCLMUL_Descramble( uint32_t crcRem, uint32_t* theData, const uint32_t* theKey, uint32_t numDwords ) {
+    return JM_CRC_PCLMUL_X( crcRem, theData, theKey, numDwords, JM_CRC_DESCRAMBLE );
+}
+#endif
+
+typedef uint32_t (*JM_CRC_XorFn)( uint32_t crcRem, uint32_t* theData, const uint32_t* theKey, uint32_t numDwords );
+
+static const struct {
+    const char* name;
+    JM_CRC_Fn fn;
+    JM_CRC_XorFn scramble;
+    JM_CRC_XorFn descramble;
+    int fused;                  // Whether (de)scrambling rides along in the CRC loop
+} crcEngines[] = {
+    [JM_CRC_ENGINE_SCALAR]  = { "scalar",  JM_CRC_Scalar,  JM_CRC_Scalar_Scramble,  JM_CRC_Scalar_Descramble,  0 },
+    [JM_CRC_ENGINE_SLICE8]  = { "slice8",  JM_CRC_Slice8,  JM_CRC_Slice8_Scramble,  JM_CRC_Slice8_Descramble,  1 },
+    [JM_CRC_ENGINE_SLICE16] = { "slice16", JM_CRC_Slice16, JM_CRC_Slice16_Scramble, JM_CRC_Slice16_Descramble, 0 },
+#ifdef JM_CRC_HAVE_PCLMUL
+    [JM_CRC_ENGINE_PCLMUL]  = { "pclmul",  JM_CRC_PCLMUL,  JM_CRC_PCLMUL_Scramble,  JM_CRC_PCLMUL_Descramble,  1 },
+#else
+    [JM_CRC_ENGINE_PCLMUL]  = { "pclmul",  NULL,           NULL,                    NULL },
+#endif
+};
+
+static int crcEngine = JM_CRC_ENGINE_SCALAR;
+
+uint32_t JM_CRC_MulMod( uint32_t a, uint32_t b ) {
+    uint32_t r = 0;
+    int i;
+
+    for( i = 31; i >= 0; i-- ) {
+        r = (r & 0x80000000) ? (r << 1) ^ 0x04c11db7 : (r << 1);
+        if( (b >> i) & 1 ) {
+            r ^= a;
+        }
+    }
+    return r;
+}
+
+uint32_t JM_CRC_XPow( uint64_t n ) {
+    uint32_t r = 1;
+    uint32_t sq = 2; // x
+
+    while( n ) {
+        if( n & 1 ) {
+            r = JM_CRC_MulMod( r, sq );
+        }
+        sq = JM_CRC_MulMod( sq, sq );
+        n >>= 1;
+    }
+    return r;
+}
+
+static int JM_CRC_Supported( int engine ) {
+    if( engine < 0 || engine >= (int)(sizeof(crcEngines) / sizeof(crcEngines[0])) || !crcEngines[engine].fn ) {
+        return 0;
+    }
+#ifdef JM_CRC_HAVE_PCLMUL
+    if( engine == JM_CRC_ENGINE_PCLMUL ) {
+        __builtin_cpu_init();
+        return __builtin_cpu_supports( "pclmul" ) && __builtin_cpu_supports( "sse2" );
+    }
+#endif
+    return 1;
+}
+
+// Known answer check of an engine against the plain byte-wise implementation,
+// using odd lengths so that every tail path gets exercised
+static int JM_CRC_Check( int engine ) {
+    uint32_t buf[131], tmp[131];
+    uint32_t i, seed = 0x52325032;
+
+    for( i = 0; i < 131; i++ ) {
+        seed = seed * 1103515245 + 12345;
+        buf[i] = seed;
+    }
+    for( i = 0; i < 131; i += 13 ) {
+        uint32_t crcRem = JM_CRC_Scalar( JM_CRC_INIT, buf, 131 - i );
+
+        if( crcEngines[engine].fn( JM_CRC_INIT, buf, 131 - i ) != crcRem ) {
+            return 0;
+        }
+
+        // Using the data as its own key scrambles it to all zeroes and back
+        memcpy( tmp, buf, sizeof(tmp) );
+        if( crcEngines[engine].scramble( JM_CRC_INIT, tmp, buf, 131 - i ) != crcRem || tmp[0] != 0 ||
+            crcEngines[engine].descramble( JM_CRC_INIT, tmp, buf, 131 - i ) != crcRem ||
+            memcmp( tmp, buf, sizeof(tmp) ) != 0 ) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+int JM_CRC_SetEngine( int engine ) {
+    if( engine == JM_CRC_ENGINE_AUTO ) {
+        for( engine = JM_CRC_ENGINE_PCLMUL; engine > JM_CRC_ENGINE_SCALAR; engine-- ) {
+            if( JM_CRC_Supported( engine ) && JM_CRC_Check( engine ) ) {
+                break;
+            }
+        }
+    } else if( !JM_CRC_Supported( engine ) ) {
+        return -1;
+    }
+    crcEngine = engine;
+    return 0;
+}
+
+const char* JM_CRC_EngineName( int engine ) {
+    if( engine == JM_CRC_ENGINE_AUTO ) {
+        engine = crcEngine;
+    }
+    return JM_CRC_Supported( engine ) ? crcEngines[engine].name : NULL;
+}
+
+// Runs before main() so the tables are never seen half-built by a caller
+__attribute__((constructor))
+void JM_CRC_Init( void ) {
+    uint32_t i, n;
+
+    for( i = 0; i < 256; i++ ) {
+        crcSliceLUT[0][i] = crcLUT[i];
+    }
+    for( n = 1; n < 16; n++ ) {
+        for( i = 0; i < 256; i++ ) {
+            uint32_t prev = crcSliceLUT[n-1][i];
+            crcSliceLUT[n][i] = crcLUT[ prev >> 24 ] ^ (prev << 8);
+        }
+    }
+
+    crcFold128[0] = JM_CRC_XPow( 128 + 64 );
+    crcFold128[1] = JM_CRC_XPow( 128 );
+    crcFold256[0] = JM_CRC_XPow( 256 + 64 );
+    crcFold256[1] = JM_CRC_XPow( 256 );
+    crcFold384[0] = JM_CRC_XPow( 384 + 64 );
+    crcFold384[1] = JM_CRC_XPow( 384 );
+    crcFold512[0] = JM_CRC_XPow( 512 + 64 );
+    crcFold512[1] = JM_CRC_XPow( 512 );
+
+    JM_CRC_SetEngine( JM_CRC_ENGINE_AUTO );
+}
+
+uint32_t JM_CRC_Update( uint32_t crcRem, const uint32_t* theData, uint32_t numDwords ) {
+    return crcEngines[crcEngine].fn( crcRem, theData, numDwords );
+}
+
+uint32_t JM_CRC_Scramble( uint32_t crcRem, uint32_t* theData, const uint32_t* theKey, uint32_t numDwords ) {
+    return crcEngines[crcEngine].scramble( crcRem, theData, theKey, numDwords );
+}
+
+uint32_t JM_CRC_Descramble( uint32_t crcRem, uint32_t* theData, const uint32_t* theKey, uint32_t numDwords ) {
+    return crcEngines[crcEngine].descramble( crcRem, theData, theKey, numDwords );
+}
+
+int JM_CRC_Fused( void ) {
+    return crcEngines[crcEngine].fused;
+}
+
+uint32_t JM_CRC( uint32_t* theData, uint32_t numDwords ) {
+    // Unusual initial remainder, and no reflection or final xor of the result
+    return JM_CRC_Update( JM_CRC_INIT, theData, numDwords );
+}
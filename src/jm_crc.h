@@ -3,7 +3,43 @@
 
 #include <stdint.h>
 
+// Unusual initial remainder used by the controller
+#define JM_CRC_INIT (0x52325032)
+
+enum {
+    JM_CRC_ENGINE_AUTO = -1,
+    JM_CRC_ENGINE_SCALAR = 0,   // One byte at a time, always available
+    JM_CRC_ENGINE_SLICE8,       // 8 bytes per iteration
+    JM_CRC_ENGINE_SLICE16,      // 16 bytes per iteration
+    JM_CRC_ENGINE_PCLMUL,       // x86 carry-less multiply folding
+};
+
+// Byte-wise table for polynomial 0x04c11db7
+extern const uint32_t crcLUT[256];
+
 uint32_t JM_CRC(uint32_t* theData, uint32_t numDwords);
 
-#endif
+// Continue a CRC from a previous remainder (JM_CRC_INIT to start a new one)
+uint32_t JM_CRC_Update(uint32_t crcRem, const uint32_t* theData, uint32_t numDwords);
+
+// Fused CRC and key stream xor, touching every dword once. Scramble CRC:s
+// theData as given and leaves it xor:ed with theKey, Descramble xors first
+// and CRC:s the result
+uint32_t JM_CRC_Scramble(uint32_t crcRem, uint32_t* theData, const uint32_t* theKey, uint32_t numDwords);
+uint32_t JM_CRC_Descramble(uint32_t crcRem, uint32_t* theData, const uint32_t* theKey, uint32_t numDwords);
 
+// Whether the current engine really does both in one pass. If not, they are
+// two passes over the data and a SIMD xor of the key beats its plain loop
+int JM_CRC_Fused(void);
+
+// Arithmetic on remainders as polynomials modulo 0x104c11db7: a*b mod P and x^n mod P
+uint32_t JM_CRC_MulMod(uint32_t a, uint32_t b);
+uint32_t JM_CRC_XPow(uint64_t n);
+
+// Engine selection, normally picked at startup from the CPU features.
+// JM_CRC_SetEngine returns -1 if the engine can't run on this machine
+void JM_CRC_Init(void);
+int JM_CRC_SetEngine(int engine);
+const char* JM_CRC_EngineName(int engine);
+
+#endif
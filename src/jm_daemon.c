@@ -0,0 +1,311 @@
+/*
+ * jmraidd - keeps the JMB394 RAID controller open and awake, answering
+ * queries from local clients over a Unix socket
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#define _GNU_SOURCE // accept4
+#include "jm_daemon.h"
+#include <stdio.h>
+#include <string.h>
+#include <signal.h>
+#include <errno.h>
+#include <time.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <endian.h>
+
+// Wire format, both ways: a query is one text line ("chip\n"), the reply is
+// a little endian uint32_t length (0 for an unknown query) followed by the data
+
+#define JM_DAEMON_MAX_CLIENTS (32)
+#define JM_DAEMON_MAX_QUERY   (32)
+#define JM_DAEMON_CACHE_SIZE  (16)
+#define JM_DAEMON_MAX_INPUT   (256)
+#define JM_DAEMON_MAX_OUTPUT  (4 * (4 + JM_DAEMON_MAX_REPLY))
+
+// Client sockets are non-blocking. Replies wait in out until the client
+// reads them; while there is no room for another one its queries are left
+// unread, so a client that does not read only holds up itself
+struct jm_daemon_client {
+    int fd;
+    uint32_t len;
+    char query[JM_DAEMON_MAX_QUERY];
+    char in[JM_DAEMON_MAX_INPUT];
+    uint32_t inPos, inLen;      // in[inPos..inLen] not looked at yet
+    uint8_t out[JM_DAEMON_MAX_OUTPUT];
+    uint32_t outPos, outLen;    // out[outPos..outLen] not written yet
+};
+
+// Last answer to each query, for coalescing
+struct jm_daemon_cache {
+    char query[JM_DAEMON_MAX_QUERY];
+    int len;
+    uint64_t when_ms;
+    uint8_t reply[JM_DAEMON_MAX_REPLY] __attribute__((aligned(4))); // Handed to jmraid_send_command()
+};
+
+static volatile sig_atomic_t daemonStop;
+
+static void JM_Daemon_Signal( int sig ) {
+    (void)sig;
+    daemonStop = 1;
+}
+
+static uint64_t JM_Daemon_Now( void ) {
+    struct timespec ts;
+
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+    return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static int JM_Daemon_WriteAll( int fd, const void* theData, size_t len ) {
+    const uint8_t* p = theData;
+
+    while( len ) {
+        ssize_t n = write( fd, p, len );
+        if( n < 0 && errno == EINTR ) {
+            continue;
+        }
+        if( n <= 0 ) {
+            return -1;
+        }
+        p += n;
+        len -= n;
+    }
+    return 0;
+}
+
+static int JM_Daemon_ReadAll( int fd, void* theData, size_t len ) {
+    uint8_t* p = theData;
+
+    while( len ) {
+        ssize_t n = read( fd, p, len );
+        if( n < 0 && errno == EINTR ) {
+            continue;
+        }
+        if( n <= 0 ) {
+            return -1;
+        }
+        p += n;
+        len -= n;
+    }
+    return 0;
+}
+
+static const struct jm_daemon_cache* JM_Daemon_Answer( struct jm_daemon_cache* theCache, const char* theQuery,
+                                                       JM_Daemon_Handler theHandler, uint32_t coalesce_ms ) {
+    struct jm_daemon_cache* entry = NULL;
+    uint64_t now = JM_Daemon_Now();
+    int i;
+
+    for( i = 0; i < JM_DAEMON_CACHE_SIZE; i++ ) {
+        if( strcmp( theCache[i].query, theQuery ) == 0 ) {
+            entry = &theCache[i];
+            if( entry->len > 0 && now - entry->when_ms <= coalesce_ms ) {
+                return entry;
+            }
+            break;
+        }
+    }
+    if( !entry ) {
+        // Recycle the stalest entry
+        entry = &theCache[0];
+        for( i = 1; i < JM_DAEMON_CACHE_SIZE; i++ ) {
+            if( theCache[i].when_ms < entry->when_ms ) {
+                entry = &theCache[i];
+            }
+        }
+        snprintf( entry->query, sizeof(entry->query), "%s", theQuery );
+    }
+
+    entry->len = theHandler( theQuery, entry->reply );
+    // Stamped after the command, so the window starts when the data was fresh
+    entry->when_ms = JM_Daemon_Now();
+    return entry;
+}
+
+// Write what the socket takes of the pending replies. -1 if the client is gone
+static int JM_Daemon_Flush( struct jm_daemon_client* theClient ) {
+    while( theClient->outPos < theClient->outLen ) {
+        ssize_t n = write( theClient->fd, theClient->out + theClient->outPos, theClient->outLen - theClient->outPos );
+        if( n < 0 && errno == EINTR ) {
+            continue;
+        }
+        if( n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK) ) {
+            return 0;
+        }
+        if( n <= 0 ) {
+            return -1;
+        }
+        theClient->outPos += n;
+    }
+    theClient->outPos = theClient->outLen = 0;
+    return 0;
+}
+
+// Pull in what the client sent and answer every complete line, as far as
+// there is room for the replies. Returns -1 once the client is gone
+static int JM_Daemon_Serve( struct jm_daemon_client* theClient, short theEvents, struct jm_daemon_cache* theCache,
+                            JM_Daemon_Handler theHandler, uint32_t coalesce_ms ) {
+    if( JM_Daemon_Flush( theClient ) < 0 ) {
+        return -1;
+    }
+    if( (theEvents & (POLLIN | POLLHUP | POLLERR)) && theClient->inPos == theClient->inLen ) {
+        ssize_t n = read( theClient->fd, theClient->in, sizeof(theClient->in) );
+        if( n < 0 && (errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK) ) {
+            return 0;
+        }
+        if( n <= 0 ) {
+            return -1;
+        }
+        theClient->inPos = 0;
+        theClient->inLen = n;
+    }
+
+    while( theClient->inPos < theClient->inLen &&
+           theClient->outLen + 4 + JM_DAEMON_MAX_REPLY <= sizeof(theClient->out) ) {
+        char c = theClient->in[theClient->inPos++];
+        if( c == '\n' ) {
+            const struct jm_daemon_cache* entry;
+            uint32_t len, wire;
+
+            theClient->query[theClient->len] = '\0';
+            theClient->len = 0;
+            entry = JM_Daemon_Answer( theCache, theClient->query, theHandler, coalesce_ms );
+            len = entry->len > 0 ? entry->len : 0;
+            wire = htole32( len );
+            memcpy( theClient->out + theClient->outLen, &wire, sizeof(wire) );
+            memcpy( theClient->out + theClient->outLen + sizeof(wire), entry->reply, len );
+            theClient->outLen += sizeof(wire) + len;
+        } else if( theClient->len < JM_DAEMON_MAX_QUERY - 1 ) {
+            theClient->query[theClient->len++] = c;
+        }
+    }
+    return JM_Daemon_Flush( theClient );
+}
+
+int JM_Daemon_Run( const char* thePath, JM_Daemon_Handler theHandler, uint32_t coalesce_ms ) {
+    static struct jm_daemon_cache cache[JM_DAEMON_CACHE_SIZE];
+    struct jm_daemon_client clients[JM_DAEMON_MAX_CLIENTS];
+    struct pollfd fds[1 + JM_DAEMON_MAX_CLIENTS];
+    struct sockaddr_un addr;
+    struct sigaction sa;
+    int listenFD, numClients = 0;
+    int i;
+
+    memset( &addr, 0, sizeof(addr) );
+    addr.sun_family = AF_UNIX;
+    if( strlen( thePath ) >= sizeof(addr.sun_path) ) {
+        printf("Socket path too long\n");
+        return -1;
+    }
+    strcpy( addr.sun_path, thePath );
+
+    if( (listenFD = socket( AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0 )) < 0 ) {
+        perror("socket");
+        return -1;
+    }
+    unlink( thePath );
+    if( bind( listenFD, (struct sockaddr*)&addr, sizeof(addr) ) < 0 || listen( listenFD, 16 ) < 0 ) {
+        perror( thePath );
+        close( listenFD );
+        return -1;
+    }
+
+    // No SA_RESTART, poll() has to return so the sector gets restored
+    memset( &sa, 0, sizeof(sa) );
+    sa.sa_handler = JM_Daemon_Signal;
+    sigaction( SIGINT, &sa, NULL );
+    sigaction( SIGTERM, &sa, NULL );
+    signal( SIGPIPE, SIG_IGN );
+
+    while( !daemonStop ) {
+        fds[0].fd = listenFD;
+        fds[0].events = POLLIN;
+        for( i = 0; i < numClients; i++ ) {
+            fds[1+i].fd = clients[i].fd;
+            // Its next queries once the last ones are all answered
+            fds[1+i].events = (clients[i].inPos == clients[i].inLen ? POLLIN : 0) |
+                              (clients[i].outLen ? POLLOUT : 0);
+        }
+        if( poll( fds, 1 + numClients, -1 ) < 0 ) {
+            if( errno == EINTR ) {
+                continue;
+            }
+            perror("poll");
+            break;
+        }
+
+        for( i = numClients - 1; i >= 0; i-- ) {
+            if( fds[1+i].revents && JM_Daemon_Serve( &clients[i], fds[1+i].revents, cache, theHandler, coalesce_ms ) < 0 ) {
+                close( clients[i].fd );
+                clients[i] = clients[--numClients];
+            }
+        }
+
+        if( fds[0].revents & POLLIN ) {
+            int fd = accept4( listenFD, NULL, NULL, SOCK_CLOEXEC | SOCK_NONBLOCK );
+            if( fd >= 0 ) {
+                if( numClients < JM_DAEMON_MAX_CLIENTS ) {
+                    clients[numClients].fd = fd;
+                    clients[numClients].len = 0;
+                    clients[numClients].inPos = clients[numClients].inLen = 0;
+                    clients[numClients].outPos = clients[numClients].outLen = 0;
+                    numClients++;
+                } else {
+                    close( fd );
+                }
+            }
+        }
+    }
+
+    for( i = 0; i < numClients; i++ ) {
+        close( clients[i].fd );
+    }
+    close( listenFD );
+    unlink( thePath );
+    return 0;
+}
+
+int JM_Daemon_Query( const char* thePath, const char* theQuery, uint8_t* theReply ) {
+    struct sockaddr_un addr;
+    uint32_t wire, len = 0;
+    int fd, retval = -1;
+
+    memset( &addr, 0, sizeof(addr) );
+    addr.sun_family = AF_UNIX;
+    if( strlen( thePath ) >= sizeof(addr.sun_path) ) {
+        return -1;
+    }
+    strcpy( addr.sun_path, thePath );
+
+    if( (fd = socket( AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0 )) < 0 ) {
+        return -1;
+    }
+    if( connect( fd, (struct sockaddr*)&addr, sizeof(addr) ) == 0 &&
+        JM_Daemon_WriteAll( fd, theQuery, strlen( theQuery ) ) == 0 &&
+        JM_Daemon_WriteAll( fd, "\n", 1 ) == 0 &&
+        JM_Daemon_ReadAll( fd, &wire, sizeof(wire) ) == 0 &&
+        (len = le32toh( wire )) > 0 && len <= JM_DAEMON_MAX_REPLY &&
+        JM_Daemon_ReadAll( fd, theReply, len ) == 0 ) {
+        retval = len;
+    }
+    close( fd );
+    return retval;
+}
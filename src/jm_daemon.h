@@ -0,0 +1,20 @@
+#ifndef JM_DAEMON_H
+#define JM_DAEMON_H
+
+#include <stdint.h>
+
+// Largest answer to a single query (two response sectors for SMART)
+#define JM_DAEMON_MAX_REPLY (2*512)
+
+// Runs a query against the controller, filling theReply and returning its
+// length in bytes, or -1 if the query is unknown or failed
+typedef int (*JM_Daemon_Handler)( const char* theQuery, uint8_t* theReply );
+
+// Serve queries on a Unix socket until SIGINT/SIGTERM. Identical queries
+// within coalesce_ms of each other are answered from the same device command
+int JM_Daemon_Run( const char* thePath, JM_Daemon_Handler theHandler, uint32_t coalesce_ms );
+
+// Client side: returns the reply length, or -1
+int JM_Daemon_Query( const char* thePath, const char* theQuery, uint8_t* theReply );
+
+#endif
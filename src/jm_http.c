@@ -0,0 +1,191 @@
+/*
+ * A minimal HTTP server, enough for a Prometheus scrape of a local page
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#define _GNU_SOURCE // accept4
+#include "jm_http.h"
+#include <stdio.h>
+#include <string.h>
+#include <signal.h>
+#include <errno.h>
+#include <netdb.h>
+#include <poll.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+
+#define JM_HTTP_MAX_REQUEST (4096)
+#define JM_HTTP_TIMEOUT_S   (2)    // A client that takes longer to send its whole request is dropped
+#define JM_HTTP_RETRY_S     (1)    // Wait after running out of file descriptors or memory
+
+static volatile sig_atomic_t httpStop;
+
+static int64_t JM_Http_Now_ms( void ) {
+    struct timespec ts;
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+    return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static void JM_Http_Signal( int sig ) {
+    (void)sig;
+    httpStop = 1;
+}
+
+static int JM_Http_Listen( const char* theAddr ) {
+    struct addrinfo hints, *res, *ai;
+    char host[256] = "127.0.0.1";
+    const char* port = theAddr;
+    const char* colon = strrchr( theAddr, ':' );
+    int fd = -1, one = 1;
+
+    if( colon ) {
+        size_t len = colon - theAddr;
+        // [::1]:9100
+        if( len >= 2 && theAddr[0] == '[' && theAddr[len - 1] == ']' ) {
+            theAddr++;
+            len -= 2;
+        }
+        if( len >= sizeof(host) ) {
+            printf("Address too long\n");
+            return -1;
+        }
+        memcpy( host, theAddr, len );
+        host[len] = 0;
+        port = colon + 1;
+    }
+
+    memset( &hints, 0, sizeof(hints) );
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = AI_PASSIVE;
+    if( getaddrinfo( host[0] ? host : NULL, port, &hints, &res ) != 0 ) {
+        printf("Cannot resolve %s\n", theAddr);
+        return -1;
+    }
+    for( ai = res; ai; ai = ai->ai_next ) {
+        if( (fd = socket( ai->ai_family, ai->ai_socktype | SOCK_CLOEXEC, ai->ai_protocol )) < 0 ) {
+            continue;
+        }
+        setsockopt( fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one) );
+        if( bind( fd, ai->ai_addr, ai->ai_addrlen ) == 0 && listen( fd, 16 ) == 0 ) {
+            break;
+        }
+        close( fd );
+        fd = -1;
+    }
+    freeaddrinfo( res );
+    if( fd < 0 ) {
+        perror( theAddr );
+    }
+    return fd;
+}
+
+// Read the request head, answer it and hang up
+static void JM_Http_Serve( int fd, JM_Http_Handler theHandler, struct jm_out* theBody ) {
+    char request[JM_HTTP_MAX_REQUEST + 1];
+    char path[256];
+    struct jm_out head;
+    const char* type = NULL;
+    struct timeval tv = { JM_HTTP_TIMEOUT_S, 0 };
+    int64_t deadline = JM_Http_Now_ms() + JM_HTTP_TIMEOUT_S * 1000;
+    size_t len = 0;
+
+    // The timeout is for the whole request, a client trickling in one byte
+    // at a time does not get to hold the loop any longer
+    setsockopt( fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv) );
+    while( len < JM_HTTP_MAX_REQUEST ) {
+        struct pollfd pfd = { fd, POLLIN, 0 };
+        int64_t left = deadline - JM_Http_Now_ms();
+        ssize_t n;
+
+        if( left <= 0 || poll( &pfd, 1, (int)left ) <= 0 ) {
+            return;
+        }
+        n = read( fd, request + len, JM_HTTP_MAX_REQUEST - len );
+        if( n <= 0 ) {
+            return;
+        }
+        len += n;
+        request[len] = 0;
+        if( strstr( request, "\r\n\r\n" ) || strstr( request, "\n\n" ) ) {
+            break;
+        }
+    }
+    request[len] = 0;
+
+    JM_Out_Reset( theBody );
+    JM_Out_Init( &head, fd, JM_OUT_TEXT );
+    if( sscanf( request, "GET %255s HTTP/", path ) != 1 ) {
+        JM_Out_Printf( &head, "HTTP/1.0 400 Bad Request\r\nContent-Length: 0\r\nConnection: close\r\n\r\n" );
+    } else if( !(type = theHandler( path, theBody )) ) {
+        JM_Out_Printf( &head, "HTTP/1.0 404 Not Found\r\nContent-Length: 0\r\nConnection: close\r\n\r\n" );
+    } else {
+        JM_Out_Printf( &head, "HTTP/1.0 200 OK\r\nContent-Type: %s\r\nContent-Length: %zu\r\nConnection: close\r\n\r\n",
+                       type, theBody->len );
+    }
+    if( JM_Out_Flush( &head ) == 0 && type ) {
+        JM_Out_Write( theBody, fd );
+    }
+    JM_Out_Free( &head );
+}
+
+int JM_Http_Run( const char* theAddr, JM_Http_Handler theHandler ) {
+    struct jm_out body;
+    struct sigaction sa;
+    int listenFD;
+
+    if( (listenFD = JM_Http_Listen( theAddr )) < 0 ) {
+        return -1;
+    }
+
+    // No SA_RESTART, accept() has to return so the sector gets restored
+    memset( &sa, 0, sizeof(sa) );
+    sa.sa_handler = JM_Http_Signal;
+    sigaction( SIGINT, &sa, NULL );
+    sigaction( SIGTERM, &sa, NULL );
+    signal( SIGPIPE, SIG_IGN );
+
+    JM_Out_Init( &body, -1, JM_OUT_TEXT );
+    while( !httpStop ) {
+        int fd = accept4( listenFD, NULL, NULL, SOCK_CLOEXEC );
+        if( fd < 0 ) {
+            switch( errno ) {
+            case EINTR:
+            case ECONNABORTED:  // The client gave up before it was accepted
+            case EPROTO:
+                continue;
+            case EMFILE:        // Short of resources, they may be back in a moment
+            case ENFILE:
+            case ENOBUFS:
+            case ENOMEM:
+                perror("accept");
+                sleep( JM_HTTP_RETRY_S );
+                continue;
+            default:
+                perror("accept");
+                break;
+            }
+            break;
+        }
+        JM_Http_Serve( fd, theHandler, &body );
+        close( fd );
+    }
+    JM_Out_Free( &body );
+    close( listenFD );
+    return 0;
+}
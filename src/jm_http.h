@@ -0,0 +1,14 @@
+#ifndef JM_HTTP_H
+#define JM_HTTP_H
+
+#include "jm_out.h"
+
+// Fills theBody with the page at thePath, returning its content type, or
+// NULL if there is no such page
+typedef const char* (*JM_Http_Handler)( const char* thePath, struct jm_out* theBody );
+
+// Serve GET requests on theAddr ("port" on 127.0.0.1, or "host:port") until
+// SIGINT/SIGTERM, one at a time and one per connection
+int JM_Http_Run( const char* theAddr, JM_Http_Handler theHandler );
+
+#endif
@@ -0,0 +1,133 @@
+/*
+ * Idle windows of the block device in front of a controller
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include "jm_idle.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <time.h>
+
+// Fields of the stat file, Documentation/block/stat.rst
+#define JM_IDLE_IN_FLIGHT (8)
+#define JM_IDLE_IO_TICKS  (9)
+
+static uint64_t JM_Idle_Now( void ) {
+    struct timespec ts;
+
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+    return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+// An sg node has no stat file of its own, the disk it belongs to is
+// /sys/class/scsi_generic/<name>/device/block/<disk>
+static int JM_Idle_Open_SG( const char* theName ) {
+    char path[512];
+    struct dirent* de;
+    DIR* dir;
+    int fd = -1;
+
+    snprintf( path, sizeof(path), "/sys/class/scsi_generic/%s/device/block", theName );
+    if( !(dir = opendir( path )) ) {
+        return -1;
+    }
+    while( (de = readdir( dir )) ) {
+        if( de->d_name[0] != '.' ) {
+            snprintf( path, sizeof(path), "/sys/class/block/%s/stat", de->d_name );
+            fd = open( path, O_RDONLY | O_CLOEXEC );
+            break;
+        }
+    }
+    closedir( dir );
+    return fd;
+}
+
+int JM_Idle_Open( struct jm_idle* theIdle, const char* theDevice ) {
+    char path[512];
+    char* real;
+    const char* name;
+
+    memset( theIdle, 0, sizeof(*theIdle) );
+    theIdle->fd = -1;
+    // /dev/disk/by-id/... links to the node
+    if( !(real = realpath( theDevice, NULL )) ) {
+        return -1;
+    }
+    name = strrchr( real, '/' ) ? strrchr( real, '/' ) + 1 : real;
+    snprintf( path, sizeof(path), "/sys/class/block/%s/stat", name );
+    if( (theIdle->fd = open( path, O_RDONLY | O_CLOEXEC )) < 0 ) {
+        theIdle->fd = JM_Idle_Open_SG( name );
+    }
+    free( real );
+    if( theIdle->fd < 0 ) {
+        return -1;
+    }
+    // The first sample only sets the baseline
+    JM_Idle_Sample( theIdle, 0, 1 );
+    theIdle->quiet = 0;
+    return 0;
+}
+
+void JM_Idle_Close( struct jm_idle* theIdle ) {
+    if( theIdle->fd >= 0 ) {
+        close( theIdle->fd );
+    }
+    theIdle->fd = -1;
+}
+
+int JM_Idle_Sample( struct jm_idle* theIdle, uint32_t theMaxBusy, uint32_t theSettle ) {
+    char buf[256];
+    unsigned long long field[JM_IDLE_IO_TICKS + 1];
+    uint64_t now = JM_Idle_Now();
+    ssize_t len;
+    char* p = buf;
+    int i;
+
+    if( theIdle->fd < 0 ) {
+        return 1;
+    }
+    if( (len = pread( theIdle->fd, buf, sizeof(buf) - 1, 0 )) <= 0 ) {
+        return 1;
+    }
+    buf[len] = 0;
+    for( i = 0; i <= JM_IDLE_IO_TICKS; i++ ) {
+        char* end;
+        field[i] = strtoull( p, &end, 10 );
+        if( end == p ) {
+            return 1;
+        }
+        p = end;
+    }
+
+    theIdle->in_flight = field[JM_IDLE_IN_FLIGHT];
+    if( now > theIdle->when ) {
+        uint64_t ticks = field[JM_IDLE_IO_TICKS] - theIdle->io_ticks;
+        theIdle->busy = ticks >= now - theIdle->when ? 1000 : ticks * 1000 / (now - theIdle->when);
+    }
+    theIdle->io_ticks = field[JM_IDLE_IO_TICKS];
+    theIdle->when = now;
+
+    if( theIdle->in_flight == 0 && theIdle->busy <= theMaxBusy ) {
+        theIdle->quiet++;
+    } else {
+        theIdle->quiet = 0;
+    }
+    return theIdle->quiet >= theSettle;
+}
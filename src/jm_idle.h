@@ -0,0 +1,30 @@
+#ifndef JM_IDLE_H
+#define JM_IDLE_H
+
+#include <stdint.h>
+
+// Whether the block device the controller shows up as is busy, from its
+// /sys/class/block/<name>/stat: the requests in flight and the share of
+// the time since the last sample with any in flight (io_ticks). The SG_IO
+// commands sent to the controller are passthrough requests, which the
+// block layer leaves out of these counters
+struct jm_idle {
+    int fd;                     // The stat file, -1 if there is none
+    uint64_t io_ticks;          // ms, at the last sample
+    uint64_t when;              // ms, CLOCK_MONOTONIC of the last sample
+    uint32_t in_flight;
+    uint32_t busy;              // Per mille of the time between the last two samples
+    uint32_t quiet;             // Samples in a row that were idle
+};
+
+// For theDevice, e.g. /dev/sdb or /dev/sg2. Returns 0, or -1 if it has no
+// stat file (then the device always counts as idle)
+int JM_Idle_Open( struct jm_idle* theIdle, const char* theDevice );
+void JM_Idle_Close( struct jm_idle* theIdle );
+
+// Takes a sample and returns 1 if the device has been idle, nothing in
+// flight and busy no more than theMaxBusy per mille, for theSettle samples
+// in a row, 0 if not
+int JM_Idle_Sample( struct jm_idle* theIdle, uint32_t theMaxBusy, uint32_t theSettle );
+
+#endif
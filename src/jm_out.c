@@ -0,0 +1,353 @@
+/*
+ * Buffered output: text and structured records (JSON Lines, CSV, binary)
+ * collected in one buffer and written with a single write()
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include "jm_out.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+void JM_Out_Init( struct jm_out* theOut, int theFD, int theFormat ) {
+    memset( theOut, 0, sizeof(*theOut) );
+    theOut->fd = theFD;
+    theOut->format = theFormat;
+}
+
+void JM_Out_Free( struct jm_out* theOut ) {
+    free( theOut->buf );
+    theOut->buf = NULL;
+    theOut->len = theOut->size = 0;
+}
+
+int JM_Out_Format( const char* theName ) {
+    static const char* const names[] = { "text", "json", "csv", "binary" };
+    int i;
+
+    for( i = 0; i < (int)(sizeof(names) / sizeof(names[0])); i++ ) {
+        if( strcmp( theName, names[i] ) == 0 ) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+// Room for theLen more bytes, doubling the buffer as needed
+static int reserve( struct jm_out* theOut, size_t theLen ) {
+    size_t size = theOut->size ? theOut->size : 4096;
+    uint8_t* buf;
+
+    if( theOut->len + theLen <= theOut->size ) {
+        return 0;
+    }
+    while( size < theOut->len + theLen ) {
+        size *= 2;
+    }
+    if( !(buf = realloc( theOut->buf, size )) ) {
+        theOut->lost = 1;
+        return -1;
+    }
+    theOut->buf = buf;
+    theOut->size = size;
+    return 0;
+}
+
+static void put( struct jm_out* theOut, const void* theData, size_t theLen ) {
+    if( reserve( theOut, theLen ) == 0 ) {
+        memcpy( theOut->buf + theOut->len, theData, theLen );
+        theOut->len += theLen;
+    }
+}
+
+static void put_byte( struct jm_out* theOut, uint8_t theByte ) {
+    put( theOut, &theByte, 1 );
+}
+
+static void put_le( struct jm_out* theOut, uint64_t theValue, int theBytes ) {
+    while( theBytes-- > 0 ) {
+        put_byte( theOut, theValue & 0xff );
+        theValue >>= 8;
+    }
+}
+
+static void put_str( struct jm_out* theOut, const char* theStr ) {
+    put( theOut, theStr, strlen( theStr ) );
+}
+
+void JM_Out_VPrintf( struct jm_out* theOut, const char* theFormat, va_list theArgs ) {
+    va_list args;
+    int len;
+
+    va_copy( args, theArgs );
+    len = vsnprintf( (char*)theOut->buf + theOut->len, theOut->size - theOut->len, theFormat, args );
+    va_end( args );
+    if( len < 0 ) {
+        return;
+    }
+    // vsnprintf() needs room for the terminating 0 as well
+    if( (size_t)len >= theOut->size - theOut->len ) {
+        if( reserve( theOut, len + 1 ) < 0 ) {
+            return;
+        }
+        vsnprintf( (char*)theOut->buf + theOut->len, theOut->size - theOut->len, theFormat, theArgs );
+    }
+    theOut->len += len;
+}
+
+void JM_Out_Printf( struct jm_out* theOut, const char* theFormat, ... ) {
+    va_list args;
+
+    va_start( args, theFormat );
+    JM_Out_VPrintf( theOut, theFormat, args );
+    va_end( args );
+}
+
+void JM_Out_Begin( struct jm_out* theOut, const char* theType ) {
+    theOut->record = theType;
+    theOut->fields = 0;
+    theOut->scratch_len = 0;
+}
+
+static struct jm_out_field* add_field( struct jm_out* theOut, const char* theKey, int theType ) {
+    struct jm_out_field* field;
+
+    if( theOut->fields >= JM_OUT_FIELDS ) {
+        theOut->lost = 1;
+        return NULL;
+    }
+    field = &theOut->field[theOut->fields++];
+    field->key = theKey;
+    field->type = theType;
+    return field;
+}
+
+void JM_Out_Str( struct jm_out* theOut, const char* theKey, const char* theValue ) {
+    struct jm_out_field* field = add_field( theOut, theKey, JM_OUT_STR );
+    size_t len = strlen( theValue );
+
+    if( !field ) {
+        return;
+    }
+    if( len > JM_OUT_SCRATCH - theOut->scratch_len ) {
+        len = JM_OUT_SCRATCH - theOut->scratch_len;
+        theOut->lost = 1;
+    }
+    memcpy( theOut->scratch + theOut->scratch_len, theValue, len );
+    field->str = theOut->scratch_len;
+    field->len = len;
+    theOut->scratch_len += len;
+}
+
+void JM_Out_U64( struct jm_out* theOut, const char* theKey, uint64_t theValue ) {
+    struct jm_out_field* field = add_field( theOut, theKey, JM_OUT_U64 );
+
+    if( field ) {
+        field->value = theValue;
+    }
+}
+
+static void put_json_str( struct jm_out* theOut, const char* theStr, size_t theLen ) {
+    size_t i;
+
+    put_byte( theOut, '"' );
+    for( i = 0; i < theLen; i++ ) {
+        uint8_t c = theStr[i];
+        if( c == '"' || c == '\\' ) {
+            put_byte( theOut, '\\' );
+            put_byte( theOut, c );
+        } else if( c < 0x20 || c >= 0x7f ) {
+            // Disk strings are not necessarily UTF-8
+            JM_Out_Printf( theOut, "\\u%04x", c );
+        } else {
+            put_byte( theOut, c );
+        }
+    }
+    put_byte( theOut, '"' );
+}
+
+static void put_csv_str( struct jm_out* theOut, const char* theStr, size_t theLen ) {
+    size_t i;
+
+    put_byte( theOut, '"' );
+    for( i = 0; i < theLen; i++ ) {
+        if( theStr[i] == '"' ) {
+            put_byte( theOut, '"' );
+        }
+        put_byte( theOut, theStr[i] );
+    }
+    put_byte( theOut, '"' );
+}
+
+static void end_text( struct jm_out* theOut ) {
+    int i;
+
+    JM_Out_Printf( theOut, "%s\n", theOut->record );
+    for( i = 0; i < theOut->fields; i++ ) {
+        const struct jm_out_field* field = &theOut->field[i];
+        if( field->type == JM_OUT_U64 ) {
+            JM_Out_Printf( theOut, "  %s = %llu\n", field->key, (unsigned long long)field->value );
+        } else {
+            JM_Out_Printf( theOut, "  %s = %.*s\n", field->key, (int)field->len, theOut->scratch + field->str );
+        }
+    }
+    put_byte( theOut, '\n' );
+}
+
+static void end_json( struct jm_out* theOut ) {
+    int i;
+
+    put_str( theOut, "{\"record\":" );
+    put_json_str( theOut, theOut->record, strlen( theOut->record ) );
+    for( i = 0; i < theOut->fields; i++ ) {
+        const struct jm_out_field* field = &theOut->field[i];
+        put_byte( theOut, ',' );
+        put_json_str( theOut, field->key, strlen( field->key ) );
+        put_byte( theOut, ':' );
+        if( field->type == JM_OUT_U64 ) {
+            JM_Out_Printf( theOut, "%llu", (unsigned long long)field->value );
+        } else {
+            put_json_str( theOut, theOut->scratch + field->str, field->len );
+        }
+    }
+    put_str( theOut, "}\n" );
+}
+
+static void end_csv( struct jm_out* theOut ) {
+    int i;
+
+    // Records of one type have the same keys, a new header for each run of them
+    if( !theOut->header || strcmp( theOut->header, theOut->record ) != 0 ) {
+        put_str( theOut, "record" );
+        for( i = 0; i < theOut->fields; i++ ) {
+            put_byte( theOut, ',' );
+            put_str( theOut, theOut->field[i].key );
+        }
+        put_byte( theOut, '\n' );
+        theOut->header = theOut->record;
+    }
+    put_str( theOut, theOut->record );
+    for( i = 0; i < theOut->fields; i++ ) {
+        const struct jm_out_field* field = &theOut->field[i];
+        put_byte( theOut, ',' );
+        if( field->type == JM_OUT_U64 ) {
+            JM_Out_Printf( theOut, "%llu", (unsigned long long)field->value );
+        } else {
+            put_csv_str( theOut, theOut->scratch + field->str, field->len );
+        }
+    }
+    put_byte( theOut, '\n' );
+}
+
+static void end_binary( struct jm_out* theOut ) {
+    size_t len = 2 + 1 + strlen( theOut->record ) + 1;
+    int i;
+
+    // All of it at once, so a record is either complete or not there at all
+    for( i = 0; i < theOut->fields; i++ ) {
+        const struct jm_out_field* field = &theOut->field[i];
+        len += 1 + strlen( field->key ) + 1 + (field->type == JM_OUT_U64 ? 8 : 2 + field->len);
+    }
+    if( reserve( theOut, len ) < 0 ) {
+        return;
+    }
+
+    put_le( theOut, len - 2, 2 );
+    len = strlen( theOut->record );
+    put_byte( theOut, len );
+    put( theOut, theOut->record, len );
+    put_byte( theOut, theOut->fields );
+    for( i = 0; i < theOut->fields; i++ ) {
+        const struct jm_out_field* field = &theOut->field[i];
+        len = strlen( field->key );
+        put_byte( theOut, len );
+        put( theOut, field->key, len );
+        put_byte( theOut, field->type );
+        if( field->type == JM_OUT_U64 ) {
+            put_le( theOut, field->value, 8 );
+        } else {
+            put_le( theOut, field->len, 2 );
+            put( theOut, theOut->scratch + field->str, field->len );
+        }
+    }
+}
+
+void JM_Out_End( struct jm_out* theOut ) {
+    switch( theOut->format ) {
+    case JM_OUT_JSON:   end_json( theOut ); break;
+    case JM_OUT_CSV:    end_csv( theOut ); break;
+    case JM_OUT_BINARY: end_binary( theOut ); break;
+    default:            end_text( theOut ); break;
+    }
+    theOut->record = NULL;
+}
+
+int JM_Out_Write( const struct jm_out* theOut, int theFD ) {
+    size_t done = 0;
+
+    while( done < theOut->len ) {
+        ssize_t len = write( theFD, theOut->buf + done, theOut->len - done );
+        if( len < 0 ) {
+            if( errno == EINTR ) {
+                continue;
+            }
+            return -1;
+        }
+        done += len;
+    }
+    return 0;
+}
+
+int JM_Out_Flush( struct jm_out* theOut ) {
+    int res = JM_Out_Write( theOut, theOut->fd );
+
+    theOut->len = 0;
+    return res;
+}
+
+int JM_Out_Save( const struct jm_out* theOut, const char* thePath ) {
+    char tmpPath[4096];
+    int fd;
+
+    if( snprintf( tmpPath, sizeof(tmpPath), "%s.tmp", thePath ) >= (int)sizeof(tmpPath) ) {
+        return -1;
+    }
+    if( (fd = open( tmpPath, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644 )) < 0 ) {
+        perror( tmpPath );
+        return -1;
+    }
+    if( JM_Out_Write( theOut, fd ) < 0 ) {
+        perror( tmpPath );
+        close( fd );
+        unlink( tmpPath );
+        return -1;
+    }
+    close( fd );
+    if( rename( tmpPath, thePath ) < 0 ) {
+        perror( thePath );
+        unlink( tmpPath );
+        return -1;
+    }
+    return 0;
+}
+
+void JM_Out_Reset( struct jm_out* theOut ) {
+    theOut->len = 0;
+    theOut->header = NULL;
+}
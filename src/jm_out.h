@@ -0,0 +1,79 @@
+#ifndef JM_OUT_H
+#define JM_OUT_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdarg.h>
+
+// Output is collected in one growable buffer and written with a single
+// write() by JM_Out_Flush(). Besides plain text it takes records, a type
+// and key/value fields, so collectors need not parse the text. Encoded as
+#define JM_OUT_TEXT   (0) // The type, then "  key = value" lines
+#define JM_OUT_JSON   (1) // JSON Lines, {"record":"<type>","<key>":<value>,...}
+#define JM_OUT_CSV    (2) // A "record,<key>,..." header whenever the type changes, then the values
+#define JM_OUT_BINARY (3) // Length-prefixed, see below
+
+// A binary record, integers little endian:
+//   u16 length of the rest of the record
+//   u8 length and the bytes of the type
+//   u8 field count, then per field
+//     u8 length and the bytes of the key
+//     u8 JM_OUT_U64 and the u64 value, or JM_OUT_STR, u16 length and the bytes
+#define JM_OUT_U64 (0)
+#define JM_OUT_STR (1)
+
+#define JM_OUT_FIELDS  (16)   // Per record
+#define JM_OUT_SCRATCH (1024) // String values of a record
+
+struct jm_out_field {
+    const char* key;            // Not copied, string literals
+    int type;                   // JM_OUT_U64 or JM_OUT_STR
+    uint64_t value;
+    size_t str;                 // Offset of the string in scratch
+    size_t len;
+};
+
+struct jm_out {
+    int fd;
+    int format;                 // JM_OUT_*
+    uint8_t* buf;
+    size_t len;
+    size_t size;
+    int lost;                   // Out of memory, some output was dropped
+    const char* record;         // Type of the record being built
+    const char* header;         // Type of the last CSV header
+    int fields;
+    struct jm_out_field field[JM_OUT_FIELDS];
+    char scratch[JM_OUT_SCRATCH];
+    size_t scratch_len;
+};
+
+// Output to theFD, records encoded as theFormat
+void JM_Out_Init( struct jm_out* theOut, int theFD, int theFormat );
+void JM_Out_Free( struct jm_out* theOut );
+
+// JM_OUT_* for "text", "json", "csv" or "binary", -1 if unknown
+int JM_Out_Format( const char* theName );
+
+// Plain text, as is
+void JM_Out_Printf( struct jm_out* theOut, const char* theFormat, ... ) __attribute__((format(printf, 2, 3)));
+void JM_Out_VPrintf( struct jm_out* theOut, const char* theFormat, va_list theArgs );
+
+// A record: JM_Out_Begin(), its fields in a fixed order, JM_Out_End()
+void JM_Out_Begin( struct jm_out* theOut, const char* theType );
+void JM_Out_Str( struct jm_out* theOut, const char* theKey, const char* theValue );
+void JM_Out_U64( struct jm_out* theOut, const char* theKey, uint64_t theValue );
+void JM_Out_End( struct jm_out* theOut );
+
+// Writes out what was collected. Returns 0, or -1 if the write failed
+int JM_Out_Flush( struct jm_out* theOut );
+
+// What was collected, kept: written to theFD, or to thePath by way of a
+// temporary file renamed over it (readers never see half of it). 0 or -1
+int JM_Out_Write( const struct jm_out* theOut, int theFD );
+int JM_Out_Save( const struct jm_out* theOut, const char* thePath );
+
+// Drops what was collected
+void JM_Out_Reset( struct jm_out* theOut );
+
+#endif
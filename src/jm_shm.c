@@ -0,0 +1,146 @@
+/*
+ * Shared memory status snapshot of a JMB394 RAID controller, so local agents
+ * can read the RAID state without sending a single command to the device
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include "jm_shm.h"
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// Give up on a publisher that seems stuck half way through an update
+#define JM_SHM_READ_TRIES (1000)
+
+struct jm_shm_status* JM_Shm_Create( const char* thePath ) {
+    struct jm_shm_status* theStatus;
+    int fd;
+
+    if( (fd = open( thePath, O_RDWR | O_CREAT | O_CLOEXEC, 0644 )) < 0 ) {
+        perror( thePath );
+        return NULL;
+    }
+    if( ftruncate( fd, sizeof(*theStatus) ) < 0 ) {
+        perror( thePath );
+        close( fd );
+        return NULL;
+    }
+    theStatus = mmap( NULL, sizeof(*theStatus), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0 );
+    close( fd );
+    if( theStatus == MAP_FAILED ) {
+        perror("mmap");
+        return NULL;
+    }
+
+    // A segment left by an older publisher (or a crashed one, with an odd
+    // sequence number) starts over
+    if( theStatus->magic != JM_SHM_MAGIC || theStatus->version != JM_SHM_VERSION ||
+        theStatus->size != sizeof(*theStatus) || (theStatus->seq & 1) ) {
+        __atomic_store_n( &theStatus->seq, 1, __ATOMIC_RELAXED );
+        __atomic_thread_fence( __ATOMIC_RELEASE );
+        memset( &theStatus->snapshot, 0, sizeof(theStatus->snapshot) );
+        theStatus->magic = JM_SHM_MAGIC;
+        theStatus->version = JM_SHM_VERSION;
+        theStatus->size = sizeof(*theStatus);
+        __atomic_store_n( &theStatus->seq, 2, __ATOMIC_RELEASE );
+    }
+    return theStatus;
+}
+
+void JM_Shm_Publish( struct jm_shm_status* theStatus, const struct jm_shm_snapshot* theSnapshot ) {
+    uint32_t seq = __atomic_load_n( &theStatus->seq, __ATOMIC_RELAXED );
+    uint64_t generation = theStatus->snapshot.generation + 1;
+
+    __atomic_store_n( &theStatus->seq, seq + 1, __ATOMIC_RELAXED );
+    __atomic_thread_fence( __ATOMIC_RELEASE );
+
+    memcpy( &theStatus->snapshot, theSnapshot, sizeof(*theSnapshot) );
+    theStatus->snapshot.generation = generation;
+
+    __atomic_store_n( &theStatus->seq, seq + 2, __ATOMIC_RELEASE );
+}
+
+// The segment is just a file anyone may have scribbled on, so never hand out
+// unterminated strings or a member count that indexes past the array
+static void JM_Shm_Sanitize( struct jm_shm_snapshot* theSnapshot ) {
+    int i;
+
+    theSnapshot->chip.product_name[sizeof(theSnapshot->chip.product_name) - 1] = 0;
+    theSnapshot->chip.manufacturer[sizeof(theSnapshot->chip.manufacturer) - 1] = 0;
+    for( i = 0; i < JM_SHM_PORTS; i++ ) {
+        struct jmraid_raid_port_info* raid = &theSnapshot->raid_port[i];
+        raid->model_name[sizeof(raid->model_name) - 1] = 0;
+        raid->serial_number[sizeof(raid->serial_number) - 1] = 0;
+        raid->password[sizeof(raid->password) - 1] = 0;
+        if( raid->member_count > 5 ) {
+            raid->member_count = 5;
+        }
+    }
+    for( i = 0; i < 5; i++ ) {
+        struct jmraid_sata_info_item* item = &theSnapshot->sata.item[i];
+        item->model_name[sizeof(item->model_name) - 1] = 0;
+        item->serial_number[sizeof(item->serial_number) - 1] = 0;
+    }
+}
+
+const struct jm_shm_status* JM_Shm_Open( const char* thePath ) {
+    const struct jm_shm_status* theStatus;
+    struct stat st;
+    int fd;
+
+    if( (fd = open( thePath, O_RDONLY | O_CLOEXEC )) < 0 ) {
+        return NULL;
+    }
+    if( fstat( fd, &st ) < 0 || st.st_size < (off_t)sizeof(*theStatus) ) {
+        close( fd );
+        return NULL;
+    }
+    theStatus = mmap( NULL, sizeof(*theStatus), PROT_READ, MAP_SHARED, fd, 0 );
+    close( fd );
+    return theStatus == MAP_FAILED ? NULL : theStatus;
+}
+
+int JM_Shm_Read( const struct jm_shm_status* theStatus, struct jm_shm_snapshot* theSnapshot ) {
+    int tries;
+
+    if( theStatus->magic != JM_SHM_MAGIC || theStatus->version != JM_SHM_VERSION ||
+        theStatus->size != sizeof(*theStatus) ) {
+        return -1;
+    }
+    for( tries = 0; tries < JM_SHM_READ_TRIES; tries++ ) {
+        uint32_t seq1 = __atomic_load_n( &theStatus->seq, __ATOMIC_ACQUIRE );
+
+        if( seq1 & 1 ) {
+            sched_yield();
+            continue;
+        }
+        memcpy( theSnapshot, &theStatus->snapshot, sizeof(*theSnapshot) );
+        __atomic_thread_fence( __ATOMIC_ACQUIRE );
+        if( __atomic_load_n( &theStatus->seq, __ATOMIC_RELAXED ) == seq1 ) {
+            JM_Shm_Sanitize( theSnapshot );
+            return theSnapshot->generation ? 0 : -1;
+        }
+    }
+    return -1;
+}
+
+void JM_Shm_Close( const struct jm_shm_status* theStatus ) {
+    munmap( (void*)theStatus, sizeof(*theStatus) );
+}
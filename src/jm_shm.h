@@ -0,0 +1,46 @@
+#ifndef JM_SHM_H
+#define JM_SHM_H
+
+#include <stdint.h>
+#include "jmraid.h"
+
+#define JM_SHM_MAGIC   (0x4a4d5348) // "JMSH"
+#define JM_SHM_VERSION (3)
+#define JM_SHM_PORTS   (5)
+
+// Decoded controller state, as published. Readers only ever see a copy taken
+// by JM_Shm_Read(), never a half-written one
+struct jm_shm_snapshot {
+    uint64_t generation;        // One per published poll, 0 until the first one
+    uint64_t updated;           // time() of the poll
+    uint32_t smart_valid;       // Bit n set if smart[n] was read
+    uint32_t raid_valid;        // Bit n set if raid_port[n] was read
+    uint32_t standby;           // Bit n set if disk n was in standby, smart[n] is older
+    uint64_t smart_read[JM_SHM_PORTS]; // time() smart[n] was read
+    struct jmraid_chip_info chip;
+    struct jmraid_raid_port_info raid_port[JM_SHM_PORTS];
+    struct jmraid_sata_info sata;
+    struct jmraid_disk_smart_info smart[JM_SHM_PORTS];
+};
+
+// The shared segment: a seqlock around the snapshot
+struct jm_shm_status {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t size;              // sizeof(struct jm_shm_status) of the publisher
+    uint32_t seq;               // Odd while the publisher is writing
+    struct jm_shm_snapshot snapshot;
+};
+
+// Publisher side: create (or reuse) the segment at thePath, then publish
+// snapshots into it. The generation is filled in by JM_Shm_Publish()
+struct jm_shm_status* JM_Shm_Create( const char* thePath );
+void JM_Shm_Publish( struct jm_shm_status* theStatus, const struct jm_shm_snapshot* theSnapshot );
+
+// Reader side: JM_Shm_Read() returns 0 with a consistent copy, or -1 if the
+// segment is not (yet) valid
+const struct jm_shm_status* JM_Shm_Open( const char* thePath );
+int JM_Shm_Read( const struct jm_shm_status* theStatus, struct jm_shm_snapshot* theSnapshot );
+void JM_Shm_Close( const struct jm_shm_status* theStatus );
+
+#endif
@@ -0,0 +1,130 @@
+/*
+ * Kernel uevents for the devices behind a controller
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include "jm_uevent.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <linux/netlink.h>
+
+#define JM_UEVENT_GROUP_KERNEL (1) // udevd sends its own (libudev) messages to group 2
+#define JM_UEVENT_MAX          (8192)
+
+int JM_Uevent_Open( void ) {
+    struct sockaddr_nl addr;
+    int fd;
+
+    if( (fd = socket( AF_NETLINK, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, NETLINK_KOBJECT_UEVENT )) < 0 ) {
+        return -1;
+    }
+    memset( &addr, 0, sizeof(addr) );
+    addr.nl_family = AF_NETLINK;
+    addr.nl_groups = JM_UEVENT_GROUP_KERNEL;
+    if( bind( fd, (struct sockaddr*)&addr, sizeof(addr) ) < 0 ) {
+        close( fd );
+        return -1;
+    }
+    return fd;
+}
+
+static void JM_Uevent_Copy( char* theDest, size_t theSize, const char* theValue ) {
+    size_t len = strlen( theValue );
+
+    if( len >= theSize ) {
+        len = theSize - 1;
+    }
+    memcpy( theDest, theValue, len );
+    theDest[len] = 0;
+}
+
+int JM_Uevent_Read( int theFD, struct jm_uevent* theEvent ) {
+    char buf[JM_UEVENT_MAX + 1];
+    struct sockaddr_nl from;
+    struct iovec iov = { buf, JM_UEVENT_MAX };
+    struct msghdr msg;
+    ssize_t len;
+    char* p;
+
+    for( ;; ) {
+        memset( &msg, 0, sizeof(msg) );
+        msg.msg_name = &from;
+        msg.msg_namelen = sizeof(from);
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        if( (len = recvmsg( theFD, &msg, 0 )) < 0 ) {
+            if( errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR ) {
+                return 0;
+            }
+            return -1;
+        }
+        // Only the kernel's, anyone can send to the group
+        if( from.nl_pid == 0 && len > 0 ) {
+            break;
+        }
+    }
+    buf[len] = 0;
+
+    // "ACTION@DEVPATH", then "KEY=value" strings, each NUL terminated
+    memset( theEvent, 0, sizeof(*theEvent) );
+    for( p = buf + strlen( buf ) + 1; p < buf + len; p += strlen( p ) + 1 ) {
+        if( strncmp( p, "ACTION=", 7 ) == 0 ) {
+            JM_Uevent_Copy( theEvent->action, sizeof(theEvent->action), p + 7 );
+        } else if( strncmp( p, "SUBSYSTEM=", 10 ) == 0 ) {
+            JM_Uevent_Copy( theEvent->subsystem, sizeof(theEvent->subsystem), p + 10 );
+        } else if( strncmp( p, "DEVPATH=", 8 ) == 0 ) {
+            JM_Uevent_Copy( theEvent->devpath, sizeof(theEvent->devpath), p + 8 );
+        } else if( strncmp( p, "DEVNAME=", 8 ) == 0 ) {
+            JM_Uevent_Copy( theEvent->devname, sizeof(theEvent->devname), p + 8 );
+        }
+    }
+    return 1;
+}
+
+int JM_Uevent_Host( const char* theDevice, char* theHost, int theSize ) {
+    char path[512];
+    char* real, *name, *sys, *host, *end;
+    int ret = -1;
+
+    if( !(real = realpath( theDevice, NULL )) ) {
+        return -1;
+    }
+    name = strrchr( real, '/' ) ? strrchr( real, '/' ) + 1 : real;
+    snprintf( path, sizeof(path), "/sys/class/block/%s", name );
+    if( !(sys = realpath( path, NULL )) ) {
+        snprintf( path, sizeof(path), "/sys/class/scsi_generic/%s", name );
+        sys = realpath( path, NULL );
+    }
+    free( real );
+    if( !sys ) {
+        return -1;
+    }
+    // /sys/devices/.../host6/target6:0:0/6:0:0:0/block/sdb
+    if( strncmp( sys, "/sys/", 5 ) == 0 && (host = strstr( sys, "/host" )) ) {
+        end = strchr( host + 1, '/' );
+        if( end && end - (sys + 4) < theSize ) {
+            memcpy( theHost, sys + 4, end - (sys + 4) );
+            theHost[end - (sys + 4)] = 0;
+            ret = 0;
+        }
+    }
+    free( sys );
+    return ret;
+}
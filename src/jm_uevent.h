@@ -0,0 +1,25 @@
+#ifndef JM_UEVENT_H
+#define JM_UEVENT_H
+
+// Kernel uevents (NETLINK_KOBJECT_UEVENT), to notice disks and devices
+// coming and going without polling for them
+struct jm_uevent {
+    char action[16];            // add, remove, change, ...
+    char subsystem[32];         // block, scsi_generic, scsi, ...
+    char devpath[256];          // Under /sys, /devices/...
+    char devname[64];           // Under /dev, if it is a device node
+};
+
+// A non-blocking socket receiving the kernel's uevents, or -1
+int JM_Uevent_Open( void );
+
+// The next uevent into theEvent. Returns 1, 0 if none is waiting or -1 on
+// an error, errno ENOBUFS if the socket overflowed and uevents were lost
+int JM_Uevent_Read( int theFD, struct jm_uevent* theEvent );
+
+// The devpath of the SCSI host theDevice (/dev/sdX or /dev/sgN) is on,
+// which the devpaths of all devices behind the same controller start with,
+// e.g. /devices/pci0000:00/0000:00:14.0/usb2/2-1/2-1:1.0/host6. 0 or -1
+int JM_Uevent_Host( const char* theDevice, char* theHost, int theSize );
+
+#endif
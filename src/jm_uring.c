@@ -0,0 +1,137 @@
+/*
+ * Minimal io_uring for the O_DIRECT block device transport
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include "jm_uring.h"
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+static int JM_Uring_Setup( unsigned entries, struct io_uring_params* p ) {
+    return syscall( __NR_io_uring_setup, entries, p );
+}
+
+static int JM_Uring_Enter( int fd, unsigned toSubmit, unsigned minComplete, unsigned flags ) {
+    return syscall( __NR_io_uring_enter, fd, toSubmit, minComplete, flags, NULL, 0 );
+}
+
+int JM_Uring_Init( struct jm_uring* theRing, unsigned entries ) {
+    struct io_uring_params p;
+
+    memset( theRing, 0, sizeof(*theRing) );
+    memset( &p, 0, sizeof(p) );
+    if( (theRing->fd = JM_Uring_Setup( entries, &p )) < 0 ) {
+        perror("io_uring_setup");
+        return -1;
+    }
+
+    theRing->sqRingSize = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    theRing->cqRingSize = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    theRing->sqesSize = p.sq_entries * sizeof(struct io_uring_sqe);
+    theRing->sqEntries = p.sq_entries;
+
+    theRing->sqRing = mmap( NULL, theRing->sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                            theRing->fd, IORING_OFF_SQ_RING );
+    theRing->cqRing = mmap( NULL, theRing->cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                            theRing->fd, IORING_OFF_CQ_RING );
+    theRing->sqes = mmap( NULL, theRing->sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                          theRing->fd, IORING_OFF_SQES );
+    if( theRing->sqRing == MAP_FAILED || theRing->cqRing == MAP_FAILED || theRing->sqes == MAP_FAILED ) {
+        perror("mmap");
+        JM_Uring_Exit( theRing );
+        return -1;
+    }
+
+    theRing->sqHead = (unsigned*)((char*)theRing->sqRing + p.sq_off.head);
+    theRing->sqTail = (unsigned*)((char*)theRing->sqRing + p.sq_off.tail);
+    theRing->sqMask = (unsigned*)((char*)theRing->sqRing + p.sq_off.ring_mask);
+    theRing->sqArray = (unsigned*)((char*)theRing->sqRing + p.sq_off.array);
+    theRing->cqHead = (unsigned*)((char*)theRing->cqRing + p.cq_off.head);
+    theRing->cqTail = (unsigned*)((char*)theRing->cqRing + p.cq_off.tail);
+    theRing->cqMask = (unsigned*)((char*)theRing->cqRing + p.cq_off.ring_mask);
+    theRing->cqes = (struct io_uring_cqe*)((char*)theRing->cqRing + p.cq_off.cqes);
+    return 0;
+}
+
+void JM_Uring_Exit( struct jm_uring* theRing ) {
+    if( theRing->sqRing && theRing->sqRing != MAP_FAILED ) {
+        munmap( theRing->sqRing, theRing->sqRingSize );
+    }
+    if( theRing->cqRing && theRing->cqRing != MAP_FAILED ) {
+        munmap( theRing->cqRing, theRing->cqRingSize );
+    }
+    if( theRing->sqes && theRing->sqes != MAP_FAILED ) {
+        munmap( theRing->sqes, theRing->sqesSize );
+    }
+    if( theRing->fd >= 0 ) {
+        close( theRing->fd );
+    }
+    theRing->fd = -1;
+}
+
+int JM_Uring_Prep( struct jm_uring* theRing, int write, int fd, void* theBuf, uint32_t len, uint64_t off, uint64_t userData, int link ) {
+    unsigned tail = *theRing->sqTail;
+    unsigned idx;
+    struct io_uring_sqe* sqe;
+
+    if( tail - __atomic_load_n( theRing->sqHead, __ATOMIC_ACQUIRE ) >= theRing->sqEntries ) {
+        return -1;
+    }
+    idx = tail & *theRing->sqMask;
+    sqe = &theRing->sqes[idx];
+    memset( sqe, 0, sizeof(*sqe) );
+    sqe->opcode = write ? IORING_OP_WRITE : IORING_OP_READ;
+    sqe->flags = link ? IOSQE_IO_LINK : 0;
+    sqe->fd = fd;
+    sqe->addr = (uint64_t)(uintptr_t)theBuf;
+    sqe->len = len;
+    sqe->off = off;
+    sqe->user_data = userData;
+
+    theRing->sqArray[idx] = idx;
+    __atomic_store_n( theRing->sqTail, tail + 1, __ATOMIC_RELEASE );
+    theRing->toSubmit++;
+    return 0;
+}
+
+int JM_Uring_Submit( struct jm_uring* theRing, unsigned waitNr ) {
+    int ret;
+
+    do {
+        ret = JM_Uring_Enter( theRing->fd, theRing->toSubmit, waitNr, waitNr ? IORING_ENTER_GETEVENTS : 0 );
+    } while( ret < 0 && errno == EINTR );
+    if( ret < 0 ) {
+        perror("io_uring_enter");
+        return -1;
+    }
+    theRing->toSubmit -= ret;
+    return ret;
+}
+
+int JM_Uring_Reap( struct jm_uring* theRing, struct io_uring_cqe* theCqe ) {
+    unsigned head = *theRing->cqHead;
+
+    if( head == __atomic_load_n( theRing->cqTail, __ATOMIC_ACQUIRE ) ) {
+        return 0;
+    }
+    *theCqe = theRing->cqes[head & *theRing->cqMask];
+    __atomic_store_n( theRing->cqHead, head + 1, __ATOMIC_RELEASE );
+    return 1;
+}
@@ -0,0 +1,44 @@
+#ifndef JM_URING_H
+#define JM_URING_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <linux/io_uring.h>
+
+// Just enough of an io_uring for sector sized reads and writes, on the raw
+// system calls so there is no liburing to depend on
+struct jm_uring {
+    int fd;
+    unsigned* sqHead;
+    unsigned* sqTail;
+    unsigned* sqMask;
+    unsigned* sqArray;
+    unsigned* cqHead;
+    unsigned* cqTail;
+    unsigned* cqMask;
+    struct io_uring_sqe* sqes;
+    struct io_uring_cqe* cqes;
+    void* sqRing;
+    void* cqRing;
+    size_t sqRingSize;
+    size_t cqRingSize;
+    size_t sqesSize;
+    unsigned sqEntries;
+    unsigned toSubmit;          // Queued since the last JM_Uring_Submit()
+};
+
+int JM_Uring_Init( struct jm_uring* theRing, unsigned entries );
+void JM_Uring_Exit( struct jm_uring* theRing );
+
+// Queue a read or write of len bytes at off. With link set the next queued
+// request only starts once this one completed successfully. Returns -1 if
+// the submission queue is full
+int JM_Uring_Prep( struct jm_uring* theRing, int write, int fd, void* theBuf, uint32_t len, uint64_t off, uint64_t userData, int link );
+
+// Submit everything queued (all of it in one system call) and wait for at least waitNr completions
+int JM_Uring_Submit( struct jm_uring* theRing, unsigned waitNr );
+
+// Take the next completion, 0 if there is none
+int JM_Uring_Reap( struct jm_uring* theRing, struct io_uring_cqe* theCqe );
+
+#endif
@@ -0,0 +1,11 @@
+#ifndef JM_WAKEUP_H
+#define JM_WAKEUP_H
+
+#include <stdint.h>
+
+#define JM_WAKEUP_SECTORS (4)
+
+// The "wakeup" handshake, precomputed including the CRC:s
+extern const uint32_t JM_WAKEUP_sectors[JM_WAKEUP_SECTORS][512/4];
+
+#endif
@@ -0,0 +1,59 @@
+/*
+ * Timer wheel for polling several classes of queries at their own rates
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include "jm_wheel.h"
+#include <string.h>
+
+void JM_Wheel_Init( struct jm_wheel* theWheel ) {
+    memset( theWheel, 0, sizeof(*theWheel) );
+}
+
+void JM_Wheel_Add( struct jm_wheel* theWheel, struct jm_wheel_timer* theTimer, uint32_t theDelay ) {
+    struct jm_wheel_timer** slot;
+
+    if( theDelay < 1 ) {
+        theDelay = 1;
+    }
+    // The slot comes round theDelay / JM_WHEEL_SLOTS times before (and
+    // not counting) the tick it is due at, or one time less if theDelay
+    // is a whole number of turns
+    slot = &theWheel->slot[(theWheel->now + theDelay) % JM_WHEEL_SLOTS];
+    theTimer->rounds = (theDelay - 1) / JM_WHEEL_SLOTS;
+    theTimer->next = *slot;
+    *slot = theTimer;
+}
+
+struct jm_wheel_timer* JM_Wheel_Tick( struct jm_wheel* theWheel ) {
+    struct jm_wheel_timer** p;
+    struct jm_wheel_timer* due = NULL;
+
+    theWheel->now++;
+    p = &theWheel->slot[theWheel->now % JM_WHEEL_SLOTS];
+    while( *p ) {
+        struct jm_wheel_timer* timer = *p;
+        if( timer->rounds == 0 ) {
+            *p = timer->next;
+            timer->next = due;
+            due = timer;
+        } else {
+            timer->rounds--;
+            p = &timer->next;
+        }
+    }
+    return due;
+}
@@ -0,0 +1,31 @@
+#ifndef JM_WHEEL_H
+#define JM_WHEEL_H
+
+#include <stdint.h>
+
+// Hashed timer wheel: a timer goes into the slot of the tick it is due at,
+// with the number of full turns still to wait, so a tick only looks at one
+// slot however many timers there are and however far out they are
+#define JM_WHEEL_SLOTS (64)
+
+struct jm_wheel_timer {
+    struct jm_wheel_timer* next;
+    uint32_t rounds;            // Turns of the wheel left
+    int id;                     // The caller's
+};
+
+struct jm_wheel {
+    uint32_t now;               // The last tick
+    struct jm_wheel_timer* slot[JM_WHEEL_SLOTS];
+};
+
+void JM_Wheel_Init( struct jm_wheel* theWheel );
+
+// theTimer falls due theDelay (at least 1) ticks after the last one
+void JM_Wheel_Add( struct jm_wheel* theWheel, struct jm_wheel_timer* theTimer, uint32_t theDelay );
+
+// Advances to the next tick, returning the timers due at it as a list linked
+// through next. They are no longer on the wheel
+struct jm_wheel_timer* JM_Wheel_Tick( struct jm_wheel* theWheel );
+
+#endif
@@ -0,0 +1,843 @@
+/*
+ * libjmraid - the JMicron JMB394 / JMS56x H/W RAID controller protocol, with
+ * all state kept in a per-device context so several controllers can be
+ * driven at once, from different threads if need be
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <scsi/sg.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <errno.h>
+#include "jmraid.h"
+#include "jm_cmd.h"
+#include "jm_wakeup.h"
+#include "sata_xor.h"
+#include <asm/byteorder.h> // For __le32_to_cpu etc
+
+#define SECTORSIZE (512)
+#define READ_CMD (0x28)
+#define WRITE_CMD (0x2a)
+#define RW_CMD_LEN (10)
+
+#ifndef SG_FLAG_MMAP_IO
+#define SG_FLAG_MMAP_IO (4) // From linux/scsi/sg.h, glibc's copy predates it
+#endif
+
+// all values from jmraid.c + 0x10
+#define JMRAID_RESULT_OFFSET (0x10 - 0x04)
+
+#warning FIXME: Should not use a hard-coded sector number (0x21) (or 0xfe), even though it is backed up and restored afterwards
+#define JMRAID_SECTOR (0xfe)
+
+// An ATA passthrough response echoes port, 0x02, addr and size, then the
+// returned registers in the layout of the request. Data, if any, follows
+// at 0x14
+#define JMRAID_ATA_RESULT_REGS (0x04)
+
+// ATA status register bits
+#define ATA_STATUS_BSY (0x80)
+#define ATA_STATUS_DRDY (0x40)
+#define ATA_STATUS_ERR (0x01)
+
+struct jmraid
+{
+        int fd;
+        uint32_t scrambled_cmd;
+        uint32_t cmd_num;
+        int awake;                      // Answered a command since it was opened
+        int borrowed;                   // save_buf holds the sector, which has to be restored
+        sg_io_hdr_t io_hdr;
+        uint8_t cdb[RW_CMD_LEN];
+        uint8_t sense[32];
+        uint8_t *mmap_buf;              // The sg reserve buffer, with JMRAID_MMAP_IO
+        int mmap_size;
+        struct jm_cmd_cache cmd_cache;
+        uint32_t save_buf[SECTORSIZE / 4];
+        double rate;                    // Token bucket, commands per second, 0 if unlimited
+        double burst;
+        double tokens;
+        uint64_t refilled_us;           // When tokens was last brought up to date
+        int priority;                   // JMRAID_PRIO_* of the commands now
+        uint64_t waited_us;             // For the budget, since jmraid_budget_waited()
+};
+
+int jmraid_controller_cmd(const char *controller, uint32_t *scrambled_cmd)
+{
+        if (strcmp(controller, "jms56x") == 0)
+        {
+                *scrambled_cmd = 0x197b0562;
+        }
+        else if (strcmp(controller, "jmb39x") == 0)
+        {
+                *scrambled_cmd = 0x197b0322;
+        }
+        else
+        {
+                return -1;
+        }
+        return 0;
+}
+
+// One sector to or from the borrowed sector, through the mapped reserve
+// buffer when buf is NULL
+static int jmraid_sg_io(struct jmraid *jmraid, int to_dev, void *buf)
+{
+        jmraid->cdb[0] = to_dev ? WRITE_CMD : READ_CMD;
+        jmraid->io_hdr.dxfer_direction = to_dev ? SG_DXFER_TO_DEV : SG_DXFER_FROM_DEV;
+        jmraid->io_hdr.flags = buf ? 0 : SG_FLAG_MMAP_IO;
+        jmraid->io_hdr.dxferp = buf;
+        return ioctl(jmraid->fd, SG_IO, &jmraid->io_hdr);
+}
+
+// The driver no longer copies the sector in and out of its reserve buffer
+// on every SG_IO once that is mapped. Only /dev/sg<X> has one
+static int jmraid_map_reserve(struct jmraid *jmraid)
+{
+        int size = 4096;
+        void *p;
+
+        if (ioctl(jmraid->fd, SG_SET_RESERVED_SIZE, &size) < 0 ||
+            ioctl(jmraid->fd, SG_GET_RESERVED_SIZE, &size) < 0 || size < SECTORSIZE)
+        {
+                return -1;
+        }
+        if ((p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, jmraid->fd, 0)) == MAP_FAILED)
+        {
+                return -1;
+        }
+        jmraid->mmap_buf = p;
+        jmraid->mmap_size = size;
+        return 0;
+}
+
+struct jmraid *jmraid_open(const char *path, const char *controller, int flags)
+{
+        struct jmraid *jmraid;
+        int k;
+
+        if (!(jmraid = calloc(1, sizeof(*jmraid))))
+        {
+                return NULL;
+        }
+        if (jmraid_controller_cmd(controller, &jmraid->scrambled_cmd) < 0)
+        {
+                fprintf(stderr, "Controller not specified\n");
+                free(jmraid);
+                return NULL;
+        }
+        if ((jmraid->fd = open(path, O_RDWR | O_CLOEXEC)) < 0)
+        {
+                fprintf(stderr, "Cannot open device\n");
+                free(jmraid);
+                return NULL;
+        }
+
+        // Check if the opened device looks like a sg one.
+        // Inspired by the sg_simple0 example
+        if ((ioctl(jmraid->fd, SG_GET_VERSION_NUM, &k) < 0) || (k < 30000))
+        {
+                fprintf(stderr, "%s is not an sg device, or old sg driver\n", path);
+                close(jmraid->fd);
+                free(jmraid);
+                return NULL;
+        }
+        if ((flags & JMRAID_MMAP_IO) && jmraid_map_reserve(jmraid) < 0)
+        {
+                fprintf(stderr, "No mmap I/O on %s, copying instead\n", path);
+        }
+
+        jmraid->cdb[5] = JMRAID_SECTOR;
+        jmraid->cdb[8] = 0x01;
+        jmraid->io_hdr.interface_id = 'S';
+        jmraid->io_hdr.cmd_len = sizeof(jmraid->cdb);
+        jmraid->io_hdr.mx_sb_len = sizeof(jmraid->sense);
+        jmraid->io_hdr.dxfer_len = SECTORSIZE;
+        jmraid->io_hdr.cmdp = jmraid->cdb;
+        jmraid->io_hdr.sbp = jmraid->sense;
+        jmraid->io_hdr.timeout = 3000;
+        jmraid->cmd_num = 1;
+
+        // Add more error handling like this later
+        if (jmraid_sg_io(jmraid, 0, jmraid->save_buf) < 0)
+        {
+                fprintf(stderr, "ioctl SG_IO failed\n");
+                if (jmraid->mmap_buf)
+                {
+                        munmap(jmraid->mmap_buf, jmraid->mmap_size);
+                }
+                close(jmraid->fd);
+                free(jmraid);
+                return NULL;
+        }
+        jmraid->borrowed = 1;
+        return jmraid;
+}
+
+int jmraid_release(struct jmraid *jmraid)
+{
+        if (!jmraid->borrowed)
+        {
+                return 0;
+        }
+        if (jmraid_sg_io(jmraid, 1, jmraid->save_buf) < 0)
+        {
+                return -1;
+        }
+        jmraid->borrowed = 0;
+        return 0;
+}
+
+void jmraid_close(struct jmraid *jmraid)
+{
+        // Restore the original data to the sector
+        jmraid_release(jmraid);
+
+        if (jmraid->mmap_buf)
+        {
+                munmap(jmraid->mmap_buf, jmraid->mmap_size);
+        }
+        close(jmraid->fd);
+        free(jmraid);
+}
+
+// Generate and send the initial "wakeup" data
+// Note that these (and all other writes) should be directed to an unused sector!!
+// They all go to the same sector, so they can't be merged into one multi-sector write
+int jmraid_wakeup(struct jmraid *jmraid)
+{
+        int i;
+
+        for (i = 0; i < JM_WAKEUP_SECTORS; i++)
+        {
+                if (jmraid_sg_io(jmraid, 1, (void *)JM_WAKEUP_sectors[i]) < 0)
+                {
+                        return -1;
+                }
+        }
+        return 0;
+}
+
+static uint64_t jmraid_now_us(void)
+{
+        struct timespec ts;
+
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+void jmraid_set_budget(struct jmraid *jmraid, double rate, uint32_t burst)
+{
+        jmraid->rate = rate;
+        jmraid->burst = burst ? burst : 1;
+        jmraid->tokens = jmraid->burst;
+        jmraid->refilled_us = jmraid_now_us();
+}
+
+void jmraid_set_priority(struct jmraid *jmraid, int priority)
+{
+        jmraid->priority = priority;
+}
+
+uint64_t jmraid_budget_waited(struct jmraid *jmraid)
+{
+        uint64_t waited = jmraid->waited_us;
+
+        jmraid->waited_us = 0;
+        return waited;
+}
+
+// Wait until the bucket has a token for one more command, and take it. Low
+// priority commands leave half of the burst to the others, so they are the
+// ones held back when the budget runs short
+static void jmraid_take_token(struct jmraid *jmraid)
+{
+        double need = 1;
+        uint64_t now;
+
+        if (jmraid->rate <= 0)
+        {
+                return;
+        }
+        if (jmraid->priority == JMRAID_PRIO_LOW)
+        {
+                need += (int)(jmraid->burst / 2);
+        }
+        for (;;)
+        {
+                struct timespec ts;
+                uint64_t wait_us;
+
+                now = jmraid_now_us();
+                jmraid->tokens += (now - jmraid->refilled_us) * jmraid->rate / 1000000;
+                if (jmraid->tokens > jmraid->burst)
+                {
+                        jmraid->tokens = jmraid->burst;
+                }
+                jmraid->refilled_us = now;
+                if (jmraid->tokens >= need)
+                {
+                        break;
+                }
+                wait_us = (need - jmraid->tokens) * 1000000 / jmraid->rate + 1;
+                ts.tv_sec = wait_us / 1000000;
+                ts.tv_nsec = (wait_us % 1000000) * 1000;
+                while (nanosleep(&ts, &ts) < 0 && errno == EINTR)
+                {
+                }
+                jmraid->waited_us += jmraid_now_us() - now;
+        }
+        jmraid->tokens -= 1;
+}
+
+// Send an already scrambled command and fetch the response
+static uint32_t jmraid_exchange(struct jmraid *jmraid, const uint32_t *cmd, uint32_t *resp)
+{
+        uint32_t crc;
+
+        jmraid_take_token(jmraid);
+
+        if (jmraid->mmap_buf)
+        {
+                memcpy(jmraid->mmap_buf, cmd, SECTORSIZE);
+                if (jmraid_sg_io(jmraid, 1, NULL) < 0 || jmraid_sg_io(jmraid, 0, NULL) < 0)
+                {
+                        return JM_CMD_IOERR;
+                }
+                memcpy(resp, jmraid->mmap_buf, SECTORSIZE);
+        }
+        else if (jmraid_sg_io(jmraid, 1, (void *)cmd) < 0 || jmraid_sg_io(jmraid, 0, resp) < 0)
+        {
+                return JM_CMD_IOERR;
+        }
+
+        // Make the 31337-looking response sane while checking it
+        crc = SATA_XOR_Decode(resp);
+        if (crc != __le32_to_cpu(resp[0x7f]))
+        {
+                fprintf(stderr, "Warning: Response CRC 0x%08x does not match the calculated 0x%08x!!\n", __le32_to_cpu(resp[0x7f]), crc);
+                return JM_CMD_BADCRC;
+        }
+        return JM_Cmd_IsEcho(cmd, resp) ? JM_CMD_ASLEEP : JM_CMD_OK;
+}
+
+uint32_t jmraid_send_command(struct jmraid *jmraid, const uint8_t *cmd, uint32_t len, uint8_t *sector)
+{
+        // The commands never change, so each one is encoded once and only gets
+        // a new command number (and CRC) patched in on every use
+        struct jm_cmd_template *tmpl = JM_CmdCache_Get(&jmraid->cmd_cache, jmraid->scrambled_cmd, cmd, len);
+        uint32_t res;
+
+        if (!tmpl)
+        {
+                return JM_CMD_IOERR;
+        }
+        // Borrowed again after jmraid_release(), its data may have changed since
+        if (!jmraid->borrowed)
+        {
+                if (jmraid_sg_io(jmraid, 0, jmraid->save_buf) < 0)
+                {
+                        return JM_CMD_IOERR;
+                }
+                jmraid->borrowed = 1;
+        }
+        res = jmraid_exchange(jmraid, JM_CmdTemplate_Issue(tmpl, jmraid->cmd_num++), (uint32_t *)sector);
+
+        // A controller that never answered yet needs the wakeup handshake first,
+        // as does one that was power cycled behind our back (it echoes the command)
+        if (res == JM_CMD_ASLEEP || (res != JM_CMD_OK && !jmraid->awake))
+        {
+                if (jmraid_wakeup(jmraid) < 0)
+                {
+                        return JM_CMD_IOERR;
+                }
+                res = jmraid_exchange(jmraid, JM_CmdTemplate_Issue(tmpl, jmraid->cmd_num++), (uint32_t *)sector);
+        }
+        if (res == JM_CMD_OK)
+        {
+                jmraid->awake = 1;
+        }
+        return res;
+}
+
+int jmraid_invoke_command(struct jmraid *jmraid, const uint8_t *data_in, uint32_t size_in, uint8_t *data_out, uint32_t size_out)
+{
+        uint8_t sector[SECTORSIZE] __attribute__((aligned(4)));
+
+        if (size_out > SECTORSIZE - JMRAID_RESULT_OFFSET)
+        {
+                size_out = SECTORSIZE - JMRAID_RESULT_OFFSET;
+        }
+        if (jmraid_send_command(jmraid, data_in, size_in, sector) != JM_CMD_OK)
+        {
+                return 0;
+        }
+        memcpy(data_out, sector + JMRAID_RESULT_OFFSET, size_out);
+        return 1;
+}
+
+int jmraid_invoke_command_get_chip_info(struct jmraid *jmraid, uint8_t *data_out, uint32_t size_out)
+{
+        const uint8_t data_in[] = { 0x00, 0x01, 0x01, 0xff };
+
+        if (!jmraid_invoke_command(jmraid, data_in, sizeof(data_in), data_out, size_out))
+        {
+                return 1;
+        }
+
+        return 0;
+}
+
+int jmraid_invoke_command_get_raid_port_info(struct jmraid *jmraid, uint8_t raid_port, uint8_t *data_out, uint32_t size_out)
+{
+        const uint8_t data_in[] = { 0x00, 0x03, 0x02, 0xff, raid_port };
+
+        if (!jmraid_invoke_command(jmraid, data_in, sizeof(data_in), data_out, size_out))
+        {
+                return 1;
+        }
+
+        return 0;
+}
+
+int jmraid_invoke_command_get_sata_info(struct jmraid *jmraid, uint8_t *data_out, uint32_t size_out)
+{
+        const uint8_t data_in[] = { 0x00, 0x02, 0x01, 0xff };
+
+        if (!jmraid_invoke_command(jmraid, data_in, sizeof(data_in), data_out, size_out))
+        {
+                return 1;
+        }
+
+        return 0;
+}
+
+int jmraid_invoke_command_get_sata_port_info(struct jmraid *jmraid, uint8_t sata_port, uint8_t *data_out, uint32_t size_out)
+{
+        const uint8_t data_in[] = { 0x00, 0x02, 0x02, 0x00, sata_port, 0xff };
+
+        if (!jmraid_invoke_command(jmraid, data_in, sizeof(data_in), data_out, size_out))
+        {
+                return 1;
+        }
+
+        return 0;
+}
+
+int jmraid_invoke_command_ata_passthrough(struct jmraid *jmraid, uint8_t sata_port, uint8_t ata_read_addr, uint8_t ata_read_size, const uint8_t *ata_data, uint8_t *data_out, uint32_t size_out)
+{
+        struct jmraid_ata_taskfile tf;
+        uint8_t frame[JMRAID_ATA_FRAME_LEN];
+
+        parse_jmraid_ata_taskfile(ata_data, &tf);
+        jmraid_build_ata_passthrough(frame, sata_port, ata_read_addr, ata_read_size, &tf);
+
+        if (!jmraid_invoke_command(jmraid, frame, sizeof(frame), data_out, size_out))
+        {
+                return 1;
+        }
+
+        return 0;
+}
+
+int jmraid_get_chip_info(struct jmraid *jmraid, struct jmraid_chip_info *info)
+{
+        uint8_t data_out[SECTORSIZE];
+
+        if (jmraid_invoke_command_get_chip_info(jmraid, data_out, sizeof(data_out)))
+        {
+                return 1;
+        }
+
+        parse_jmraid_chip_info(data_out, info);
+
+        return 0;
+}
+
+int jmraid_get_raid_port_info(struct jmraid *jmraid, uint8_t raid_port, struct jmraid_raid_port_info *info)
+{
+        uint8_t data_out[SECTORSIZE];
+
+        if (jmraid_invoke_command_get_raid_port_info(jmraid, raid_port, data_out, sizeof(data_out)))
+        {
+                return 1;
+        }
+
+        parse_jmraid_raid_port_info(data_out, info);
+
+        return 0;
+}
+
+int jmraid_get_sata_info(struct jmraid *jmraid, struct jmraid_sata_info *info)
+{
+        uint8_t data_out[SECTORSIZE];
+
+        if (jmraid_invoke_command_get_sata_info(jmraid, data_out, sizeof(data_out)))
+        {
+                return 1;
+        }
+
+        parse_jmraid_sata_info(data_out, info);
+
+        return 0;
+}
+
+int jmraid_get_sata_port_info(struct jmraid *jmraid, uint8_t index, struct jmraid_sata_port_info *info)
+{
+        uint8_t data_out[SECTORSIZE];
+
+        if (jmraid_invoke_command_get_sata_port_info(jmraid, index, data_out, sizeof(data_out)))
+        {
+                return 1;
+        }
+
+        parse_jmraid_sata_port_info(data_out, info);
+
+        return 0;
+}
+
+int jmraid_ata_passthrough(struct jmraid *jmraid, uint8_t sata_port, const struct jmraid_ata_taskfile *tf, uint8_t ata_read_size,
+                           struct jmraid_ata_taskfile *tf_out, uint8_t *data_out, uint32_t size_out)
+{
+        uint8_t frame[JMRAID_ATA_FRAME_LEN];
+        uint8_t payload[SECTORSIZE];
+
+        jmraid_build_ata_passthrough(frame, sata_port, 0x00, ata_read_size, tf);
+
+        if (!jmraid_invoke_command(jmraid, frame, sizeof(frame), payload, sizeof(payload)))
+        {
+                return 1;
+        }
+
+        if (tf_out)
+        {
+                parse_jmraid_ata_taskfile(payload + JMRAID_ATA_RESULT_REGS, tf_out);
+        }
+        if (data_out)
+        {
+                if (size_out > SECTORSIZE - JMRAID_RESULT_OFFSET)
+                {
+                        size_out = SECTORSIZE - JMRAID_RESULT_OFFSET;
+                }
+                memcpy(data_out, payload, size_out);
+        }
+
+        return 0;
+}
+
+int jmraid_get_disk_smart_info(struct jmraid *jmraid, uint8_t sata_port, struct jmraid_disk_smart_info *info)
+{
+        struct jmraid_ata_taskfile tf;
+        uint8_t data_out_1[SECTORSIZE];
+        uint8_t data_out_2[SECTORSIZE];
+
+        jmraid_smart_taskfile(&tf, JMRAID_SMART_READ_VALUES);
+        if (jmraid_ata_passthrough(jmraid, sata_port, &tf, JMRAID_SMART_READ_SIZE, NULL, data_out_1, sizeof(data_out_1)))
+        {
+                return 1;
+        }
+
+        jmraid_smart_taskfile(&tf, JMRAID_SMART_READ_THRESHOLDS);
+        if (jmraid_ata_passthrough(jmraid, sata_port, &tf, JMRAID_SMART_READ_SIZE, NULL, data_out_2, sizeof(data_out_2)))
+        {
+                return 1;
+        }
+
+        parse_jmraid_disk_smart_info(data_out_1, data_out_2, info);
+
+        return 0;
+}
+
+int jmraid_get_disk_power_mode(struct jmraid *jmraid, uint8_t sata_port, uint8_t *mode)
+{
+        struct jmraid_ata_taskfile tf;
+
+        memset(&tf, 0, sizeof(tf));
+        tf.count = JMRAID_POWER_UNKNOWN; // The disk overwrites it
+        tf.device = 0xA0;
+        tf.command = 0xE5; // CHECK POWER MODE, no data and no spin up
+
+        if (jmraid_ata_passthrough(jmraid, sata_port, &tf, 0x00, &tf, NULL, 0))
+        {
+                return 1;
+        }
+
+        *mode = tf.count;
+
+        return 0;
+}
+
+int jmraid_get_disk_smart_status(struct jmraid *jmraid, uint8_t sata_port, int *status)
+{
+        struct jmraid_ata_taskfile tf;
+
+        jmraid_smart_taskfile(&tf, JMRAID_SMART_RETURN_STATUS);
+        if (jmraid_ata_passthrough(jmraid, sata_port, &tf, 0x00, &tf, NULL, 0))
+        {
+                return 1;
+        }
+
+        *status = parse_jmraid_smart_status(&tf);
+
+        return 0;
+}
+
+void jmraid_smart_taskfile(struct jmraid_ata_taskfile *tf, uint8_t feature)
+{
+        memset(tf, 0, sizeof(*tf));
+        tf->feature = feature;
+        tf->lba = 0xC24F00; // The SMART signature in LBA mid and high
+        tf->device = 0xA0;
+        tf->command = 0xB0;
+}
+
+void jmraid_build_ata_passthrough(uint8_t *frame, uint8_t sata_port, uint8_t ata_read_addr, uint8_t ata_read_size, const struct jmraid_ata_taskfile *tf)
+{
+        frame[0] = 0x00;
+        frame[1] = 0x02;
+        frame[2] = 0x03;
+        frame[3] = 0xff;
+        frame[4] = sata_port;
+        frame[5] = 0x02; // ?
+        frame[6] = ata_read_addr;
+        frame[7] = ata_read_size;
+
+        // One 16-bit word per register, the high byte presumably the
+        // previous (48-bit) value, 0 in every command known so far
+        memset(frame + 8, 0, 16);
+        frame[8 + 2] = tf->feature;
+        frame[8 + 3] = tf->feature >> 8;
+        frame[8 + 4] = tf->count;
+        frame[8 + 5] = tf->count >> 8;
+        frame[8 + 6] = tf->lba;
+        frame[8 + 7] = tf->lba >> 24;
+        frame[8 + 8] = tf->lba >> 8;
+        frame[8 + 9] = tf->lba >> 32;
+        frame[8 + 10] = tf->lba >> 16;
+        frame[8 + 11] = tf->lba >> 40;
+        frame[8 + 12] = tf->device;
+        frame[8 + 14] = tf->command;
+}
+
+void parse_jmraid_ata_taskfile(const uint8_t *src, struct jmraid_ata_taskfile *dst)
+{
+        dst->feature = src[2] | (src[3] << 8);
+        dst->count = src[4] | (src[5] << 8);
+        dst->lba = (uint64_t)src[6] | ((uint64_t)src[8] << 8) | ((uint64_t)src[10] << 16) |
+                   ((uint64_t)src[7] << 24) | ((uint64_t)src[9] << 32) | ((uint64_t)src[11] << 40);
+        dst->device = src[12];
+        dst->command = src[14];
+}
+
+int parse_jmraid_smart_status(const struct jmraid_ata_taskfile *tf)
+{
+        // The request carries the PASSED signature too. Unless the status
+        // register shows the disk answered (not the 0xB0 of the request,
+        // ready, not busy, no error) these may just be the request's
+        // registers echoed
+        if (tf->command == 0xB0 || (tf->command & (ATA_STATUS_BSY | ATA_STATUS_DRDY | ATA_STATUS_ERR)) != ATA_STATUS_DRDY)
+        {
+                return JMRAID_SMART_UNKNOWN;
+        }
+
+        switch ((tf->lba >> 8) & 0xffff)
+        {
+        case 0xC24F:
+                return JMRAID_SMART_PASSED;
+        case 0x2CF4:
+                return JMRAID_SMART_FAILED;
+        default:
+                return JMRAID_SMART_UNKNOWN;
+        }
+}
+
+static uint32_t read_u32_le(const uint8_t *p)
+{
+  return (p[0] << 0) | (p[1] << 8) | (p[2] << 16) | (p[3] << 24);
+}
+
+static uint16_t read_u16_le(const uint8_t *p)
+{
+  return (p[0] << 0) | (p[1] << 8);
+}
+
+static void swap_bytes(uint8_t *data, uint32_t size)
+{
+  while (size > 1)
+  {
+    uint8_t temp;
+    temp = data[0];
+    data[0] = data[1];
+    data[1] = temp;
+    data += 2;
+    size -= 2;
+  }
+}
+
+void parse_jmraid_raid_port_info(const uint8_t *src, struct jmraid_raid_port_info *dst) {
+  const uint8_t *p = src;
+  int i;
+
+  memset(dst, 0, sizeof(struct jmraid_raid_port_info));
+
+  p += 0x04;
+  dst->port_state = p[0x40];
+  memcpy(dst->model_name, p + 0x00, 0x28);
+  swap_bytes(dst->model_name, 0x28);
+  memcpy(dst->serial_number, p + 0x28, 0x14);
+  swap_bytes(dst->serial_number, 0x14);
+  dst->level = p[0x50];
+  dst->capacity = ((uint64_t)read_u32_le(p + 0x3C)) * (32 * 1024 * 1024);
+  dst->state = p[0x42];
+  dst->member_count = p[0x51];
+  dst->rebuild_priority = read_u16_le(p + 0x60);
+  dst->standby_timer = read_u16_le(p + 0x62) * 10;
+  memcpy(dst->password, p + 0x78, 0x08);
+  dst->rebuild_progress =
+      ((uint64_t)read_u32_le(p + 0x5C)) * (32 * 1024 * 1024);
+
+  p += 0xA0;
+  for (i = 0; i < 5; i++) {
+    struct jmraid_raid_port_info_member *member = &dst->member[i];
+    member->ready = p[0x00];
+    member->lba48_support = p[0x04];
+    member->sata_page = p[0x06];
+    member->sata_port = p[0x07];
+    member->sata_base = read_u32_le(p + 0x08);
+    member->sata_size = ((uint64_t)read_u32_le(p + 0x0C)) * (32 * 1024 * 1024);
+    p += 0x20;
+  }
+}
+
+void parse_jmraid_chip_info(const uint8_t *src, struct jmraid_chip_info *dst)
+{
+        const uint8_t *p = src;
+
+        memset(dst, 0, sizeof(struct jmraid_chip_info));
+
+        dst->firmware_version[0] = p[0];
+        dst->firmware_version[1] = p[1];
+        dst->firmware_version[2] = p[2];
+        dst->firmware_version[3] = p[3];
+        memcpy(dst->product_name, p + 0x14, 0x20);
+        memcpy(dst->manufacturer, p + 0x34, 0x20);
+        dst->serial_number = read_u32_le(p + 0xA0);
+}
+
+void parse_jmraid_sata_info(const uint8_t *src, struct jmraid_sata_info *dst)
+{
+        const uint8_t *p = src;
+        int i;
+
+        memset(dst, 0, sizeof(struct jmraid_sata_info));
+
+        p += 0x04;
+        for (i = 0; i < 5; i++)
+        {
+                struct jmraid_sata_info_item *item = &dst->item[i];
+                memcpy(item->model_name, p + 0x00, 0x28);
+                swap_bytes(item->model_name, 0x28);
+                memcpy(item->serial_number, p + 0x28, 0x14);
+                swap_bytes(item->serial_number, 0x14);
+                item->capacity = ((uint64_t)read_u32_le(p + 0x3C)) * (32 * 1024 * 1024);
+                item->port_type = p[0x48];
+                item->port_speed = p[0x4A];
+                item->page_0_state = p[0x41];
+                item->page_0_raid_index = p[0x42];
+                item->page_0_raid_member_index = p[0x43];
+                item->port = p[0x49];
+                p += 0x50;
+        }
+}
+
+void parse_jmraid_sata_port_info(const uint8_t *src, struct jmraid_sata_port_info *dst)
+{
+        const uint8_t *p = src;
+
+        memset(dst, 0, sizeof(struct jmraid_sata_port_info));
+
+        p += 0x04;
+        memcpy(dst->model_name, p + 0x00, 0x28);
+        swap_bytes(dst->model_name, 0x28);
+        memcpy(dst->serial_number, p + 0x28, 0x14);
+        swap_bytes(dst->serial_number, 0x14);
+        memcpy(dst->firmware_version, p + 0x40, 0x08);
+        swap_bytes(dst->firmware_version, 0x08);
+        dst->capacity = ((uint64_t)read_u32_le(p + 0x3C)) * (32 * 1024 * 1024);
+        dst->port_type = p[0x60];
+        dst->port = p[0x5A];
+        dst->capacity_used = ((uint64_t)read_u32_le(p + 0xCC)) * (32 * 1024 * 1024);
+        dst->page_0_state = p[0xBD];
+        dst->page_0_raid_index = p[0xBE];
+        dst->page_0_raid_member_index = p[0xBF];
+}
+
+void parse_jmraid_disk_smart_info(const uint8_t *src1, const uint8_t *src2, struct jmraid_disk_smart_info *dst)
+{
+
+        memset(dst, 0, sizeof(struct jmraid_disk_smart_info));
+
+        if (src1)
+        {
+                const uint8_t *p = src1;
+                int i;
+
+                p += 0x14;
+                p += 0x02;
+                for (i = 0; i < 30; i++)
+                {
+                        // 00h | 1 | Attribute ID Number (01h to FFh)
+                        // 01h | 2 | Status Flags 2
+                        // 03h | 1 | Attribute Value (valid values from 01h to FDh)
+                        // 04h | 8 | Vendor specific
+                        if (p[0] != 0)
+                        {
+                                struct jmraid_disk_smart_info_attribute *attribute = &dst->attribute[i];
+                                attribute->id = p[0];
+                                attribute->flags = read_u16_le(p + 1);
+                                attribute->current_value = p[3];
+                                attribute->worst_value = p[4];
+                                attribute->raw_value = read_u32_le(p + 5) | ((uint64_t)read_u16_le(p + 9) << 32);
+                        }
+                        p += 0x0C;
+                }
+        }
+
+        if (src2)
+        {
+                const uint8_t *p = src2;
+                int i;
+
+                p += 0x14;
+                p += 0x02;
+                for (i = 0; i < 30; i++)
+                {
+                        if (p[0] != 0)
+                        {
+                                struct jmraid_disk_smart_info_attribute *attribute = &dst->attribute[i];
+                                attribute->threshold = p[1];
+                        }
+                        p += 0x0C;
+                }
+        }
+}
@@ -1,6 +1,8 @@
 #ifndef _JMRAID_H_
 #define _JMRAID_H_
 
+#include <stdint.h>
+
 struct jmraid_raid_port_info_member
 {
 	uint8_t ready;
@@ -68,6 +70,18 @@ struct jmraid_sata_info
         struct jmraid_sata_info_item item[5];
 };
 
+// The ATA registers of a passthrough command, or returned by one. LBA low,
+// mid and high are bits 0-7, 8-15 and 16-23 of lba, the 48-bit high bytes
+// above that
+struct jmraid_ata_taskfile
+{
+        uint16_t feature;
+        uint16_t count;
+        uint64_t lba;
+        uint8_t device;
+        uint8_t command;
+};
+
 struct jmraid_sata_port_info
 {
         char model_name[0x28 + 1];
@@ -82,5 +96,117 @@ struct jmraid_sata_port_info
         uint8_t page_0_raid_member_index;
 };
 
+/*
+ * libjmraid. Everything about a device lives in its struct jmraid, so
+ * different devices can be used from different threads without locking.
+ * The jmraid_invoke_command*() and jmraid_get_*() calls return 0 on
+ * success, except jmraid_invoke_command() itself (nonzero on success)
+ */
+struct jmraid;
+
+#define JMRAID_MMAP_IO (1) // Exchange sectors through the mapped sg reserve buffer
+
+// "jms56x" or "jmb39x" to the scrambled command code, -1 if unknown
+int jmraid_controller_cmd(const char *controller, uint32_t *scrambled_cmd);
+
+// Opens the sg device and backs up the borrowed sector, which
+// jmraid_close() restores
+struct jmraid *jmraid_open(const char *path, const char *controller, int flags);
+void jmraid_close(struct jmraid *jmraid);
+
+// Restores the borrowed sector while keeping the device open. The next
+// command backs it up (afresh) and borrows it again. 0 on success
+int jmraid_release(struct jmraid *jmraid);
+
+// I/O budget: every command (a write and a read of the borrowed sector)
+// takes a token from a bucket refilled at rate per second, holding at most
+// burst. A command waits when there is none. Unlimited until set, a rate
+// of 0 lifts it again
+void jmraid_set_budget(struct jmraid *jmraid, double rate, uint32_t burst);
+
+// Low priority commands wait while the bucket is below half its burst, so
+// they are deferred in favour of normal ones
+#define JMRAID_PRIO_NORMAL (0)
+#define JMRAID_PRIO_LOW (1)
+void jmraid_set_priority(struct jmraid *jmraid, int priority);
+
+// Microseconds spent waiting for the budget since the last call
+uint64_t jmraid_budget_waited(struct jmraid *jmraid);
+
+int jmraid_wakeup(struct jmraid *jmraid);
+
+// Send a command (the bytes after the scrambled code and command number),
+// waking the controller up if needed, and return the whole response
+// sector. sector is descrambled in place as dwords, so it has to be 4 byte
+// aligned. Returns JM_CMD_OK etc. (jm_cmd.h)
+uint32_t jmraid_send_command(struct jmraid *jmraid, const uint8_t *cmd, uint32_t len, uint8_t *sector);
+
+int jmraid_invoke_command(struct jmraid *jmraid, const uint8_t *data_in, uint32_t size_in, uint8_t *data_out, uint32_t size_out);
+int jmraid_invoke_command_get_chip_info(struct jmraid *jmraid, uint8_t *data_out, uint32_t size_out);
+int jmraid_invoke_command_get_raid_port_info(struct jmraid *jmraid, uint8_t raid_port, uint8_t *data_out, uint32_t size_out);
+int jmraid_invoke_command_get_sata_info(struct jmraid *jmraid, uint8_t *data_out, uint32_t size_out);
+int jmraid_invoke_command_get_sata_port_info(struct jmraid *jmraid, uint8_t sata_port, uint8_t *data_out, uint32_t size_out);
+// The 16 register bytes in ata_data are decoded into a jmraid_ata_taskfile
+// and sent as by jmraid_build_ata_passthrough(), bytes it has no register
+// for are sent as 0. New code uses jmraid_ata_passthrough()
+int jmraid_invoke_command_ata_passthrough(struct jmraid *jmraid, uint8_t sata_port, uint8_t ata_read_addr, uint8_t ata_read_size, const uint8_t *ata_data, uint8_t *data_out, uint32_t size_out);
+
+int jmraid_get_chip_info(struct jmraid *jmraid, struct jmraid_chip_info *info);
+int jmraid_get_raid_port_info(struct jmraid *jmraid, uint8_t raid_port, struct jmraid_raid_port_info *info);
+int jmraid_get_sata_info(struct jmraid *jmraid, struct jmraid_sata_info *info);
+int jmraid_get_sata_port_info(struct jmraid *jmraid, uint8_t index, struct jmraid_sata_port_info *info);
+int jmraid_get_disk_smart_info(struct jmraid *jmraid, uint8_t sata_port, struct jmraid_disk_smart_info *info);
+
+// ATA CHECK POWER MODE, which does not spin the disk up. *mode is the
+// returned sector count: JMRAID_POWER_STANDBY, _IDLE or _ACTIVE. Where the
+// response has the returned registers is not verified on hardware; the
+// request carries JMRAID_POWER_UNKNOWN, no disk returns that, so it being
+// *mode means the registers read back are the request's, not the disk's
+#define JMRAID_POWER_STANDBY (0x00)
+#define JMRAID_POWER_IDLE (0x80)
+#define JMRAID_POWER_ACTIVE (0xff)
+#define JMRAID_POWER_UNKNOWN (0xa5)
+int jmraid_get_disk_power_mode(struct jmraid *jmraid, uint8_t sata_port, uint8_t *mode);
+
+// SMART RETURN STATUS, the disk's own verdict in one command without data.
+// *status is JMRAID_SMART_PASSED, _FAILED (a threshold is exceeded) or
+// _UNKNOWN (registers that are neither, or a status register that does not
+// show a completed command: where the response has the returned registers
+// is not verified on hardware, and an echo of the request would otherwise
+// read as PASSED)
+#define JMRAID_SMART_PASSED (0)
+#define JMRAID_SMART_FAILED (1)
+#define JMRAID_SMART_UNKNOWN (2)
+int jmraid_get_disk_smart_status(struct jmraid *jmraid, uint8_t sata_port, int *status);
+
+// Any ATA command through the controller: tf goes to the disk, the returned
+// registers to *tf_out (may be tf) and the response payload (data from 0x14)
+// to data_out, either of them may be NULL. ata_read_size is 0 for commands
+// without data, JMRAID_SMART_READ_SIZE for a SMART read
+#define JMRAID_SMART_READ_SIZE (0xE0)
+int jmraid_ata_passthrough(struct jmraid *jmraid, uint8_t sata_port, const struct jmraid_ata_taskfile *tf, uint8_t ata_read_size,
+                           struct jmraid_ata_taskfile *tf_out, uint8_t *data_out, uint32_t size_out);
+
+// The frame jmraid_ata_passthrough() sends, for use with
+// jmraid_send_command() or a prebuilt query
+#define JMRAID_ATA_FRAME_LEN (24)
+void jmraid_build_ata_passthrough(uint8_t *frame, uint8_t sata_port, uint8_t ata_read_addr, uint8_t ata_read_size, const struct jmraid_ata_taskfile *tf);
+
+// A SMART command (ATA 0xB0) with the given feature
+#define JMRAID_SMART_READ_VALUES (0xD0)
+#define JMRAID_SMART_READ_THRESHOLDS (0xD1)
+#define JMRAID_SMART_RETURN_STATUS (0xDA)
+void jmraid_smart_taskfile(struct jmraid_ata_taskfile *tf, uint8_t feature);
+
+// Decoding of the responses, as returned by jmraid_invoke_command()
+void parse_jmraid_chip_info(const uint8_t *src, struct jmraid_chip_info *dst);
+void parse_jmraid_raid_port_info(const uint8_t *src, struct jmraid_raid_port_info *dst);
+void parse_jmraid_sata_info(const uint8_t *src, struct jmraid_sata_info *dst);
+void parse_jmraid_sata_port_info(const uint8_t *src, struct jmraid_sata_port_info *dst);
+void parse_jmraid_disk_smart_info(const uint8_t *src1, const uint8_t *src2, struct jmraid_disk_smart_info *dst);
+// The 16 register bytes of a passthrough frame or response
+void parse_jmraid_ata_taskfile(const uint8_t *src, struct jmraid_ata_taskfile *dst);
+// JMRAID_SMART_* of the registers SMART RETURN STATUS returned
+int parse_jmraid_smart_status(const struct jmraid_ata_taskfile *tf);
 
 #endif
@@ -18,6 +18,15 @@
  */
 
 #include "sata_xor.h"
+#include "jm_crc.h"
+#include <stdlib.h>
+#include <string.h>
+#include <asm/byteorder.h> // __cpu_to_le32 etc.
+
+#if defined(__x86_64__) || defined(__i386__)
+#define SATA_XOR_HAVE_X86
+#include <immintrin.h>
+#endif
 
 const uint32_t SATA_XOR_scramblerdata[512/4] = { \
     0x4467c108, 0x3d0d9104, 0x61db449c, 0x5c0063ba, 0x19c47848, 0x1f8ac89f, 0x837fa38f, 0x717acf08, \
@@ -37,11 +46,297 @@ const uint32_t SATA_XOR_scramblerdata[512/4] = { \
     0x9b4b3de9, 0x1318195b, 0x08c1a9d2, 0x8c1262ce, 0x43e36412, 0x1c59e3bb, 0xb9cd7f57, 0xab476572, \
     0xc161feb8, 0x25ecc208, 0x891cb98e, 0xa7d26ddf, 0x5210a736, 0xaa2d212a, 0x77d13198, 0x403ba835 };
 
-void SATA_XOR( uint32_t* theData ) {
+// The table above is not the 16-bit SATA scrambler, but the same idea on the
+// CRC-32 polynomial: dword i is a fixed linear function of the LFSR state
+// x^(32*i) mod 0x104c11db7. SATA_XOR_outputMap[j] is the output dword for the
+// state bit x^j on its own, so xorOutLUT[k][b] gives the output for byte k of
+// the state being b
+static const uint32_t SATA_XOR_outputMap[32] = { \
+    0x4467c108, 0x11122e0e, 0xca2b67c1, 0x82a7ad17, 0x2330c64d, 0xe1317910, 0x6e02b826, 0x2ffb7453, \
+    0x56921c64, 0x246847b2, 0xb07d1960, 0x3462b0ad, 0x17557680, 0xf6040b9c, 0x8816d3aa, 0x8dedaf79, \
+    0xdbfba23d, 0xfbd9e587, 0x5bb4fae6, 0xcfd74adb, 0xd086ac5f, 0x2302e7cb, 0xeb0c3e61, 0xc6e1913b, \
+    0x35608077, 0x715a51f1, 0x7c671c83, 0x3cbe15cf, 0x0c8455e8, 0x04fe0a18, 0xb8182629, 0xa2d19091 };
+
+static uint32_t xorOutLUT[4][256];
+static int xorStreamValid;
+
+static inline uint32_t SATA_XOR_Output( uint32_t state ) {
+    return xorOutLUT[0][ state&0xff ] ^ xorOutLUT[1][ (state>>8)&0xff ] ^
+           xorOutLUT[2][ (state>>16)&0xff ] ^ xorOutLUT[3][ state>>24 ];
+}
+
+// Advancing 32 bits is the CRC of a zero dword
+static inline uint32_t SATA_XOR_Step( uint32_t state ) {
+    state = crcLUT[ state >> 24 ] ^ (state << 8);
+    state = crcLUT[ state >> 24 ] ^ (state << 8);
+    state = crcLUT[ state >> 24 ] ^ (state << 8);
+    state = crcLUT[ state >> 24 ] ^ (state << 8);
+    return state;
+}
+
+static uint32_t SATA_XOR_Generate( uint32_t* theKey, uint32_t state, uint32_t numDwords ) {
+    uint32_t i;
+
+    for( i = 0; i < numDwords; i++ ) {
+        theKey[i] = SATA_XOR_Output( state );
+        state = SATA_XOR_Step( state );
+    }
+    return state;
+}
+
+static void SATA_XOR_StreamInit( void ) {
+    uint32_t key[512/4];
+    uint32_t k, b, j;
+
+    for( k = 0; k < 4; k++ ) {
+        for( b = 0; b < 256; b++ ) {
+            uint32_t out = 0;
+            for( j = 0; j < 8; j++ ) {
+                if( (b >> j) & 1 ) {
+                    out ^= SATA_XOR_outputMap[k*8 + j];
+                }
+            }
+            xorOutLUT[k][b] = out;
+        }
+    }
+
+    // Has to reproduce the one sector everybody agrees on
+    SATA_XOR_Generate( key, 1, 512/4 );
+    xorStreamValid = (memcmp( key, SATA_XOR_scramblerdata, sizeof(key) ) == 0);
+}
+
+uint32_t SATA_XOR_Seek( uint64_t dwordOffset ) {
+    // x^(32*dwordOffset), without overflowing the exponent
+    uint32_t state = 1, sq = JM_CRC_XPow( 32 );
+
+    while( dwordOffset ) {
+        if( dwordOffset & 1 ) {
+            state = JM_CRC_MulMod( state, sq );
+        }
+        sq = JM_CRC_MulMod( sq, sq );
+        dwordOffset >>= 1;
+    }
+    return state;
+}
+
+int SATA_XOR_Keystream( uint32_t* theKey, uint64_t dwordOffset, uint32_t numDwords ) {
+    if( !xorStreamValid ) {
+        return -1;
+    }
+    if( dwordOffset + numDwords <= 512/4 ) {
+        memcpy( theKey, SATA_XOR_scramblerdata + dwordOffset, numDwords * 4 );
+        return 0;
+    }
+    SATA_XOR_Generate( theKey, SATA_XOR_Seek( dwordOffset ), numDwords );
+    return 0;
+}
+
+int SATA_XOR_Stream( uint32_t* theData, uint64_t dwordOffset, uint32_t numDwords ) {
+    uint32_t state;
+    uint32_t i;
+
+    if( !xorStreamValid ) {
+        return -1;
+    }
+    state = SATA_XOR_Seek( dwordOffset );
+    for( i = 0; i < numDwords; i++ ) {
+        theData[i] ^= SATA_XOR_Output( state );
+        state = SATA_XOR_Step( state );
+    }
+    return 0;
+}
+
+const uint32_t* SATA_XOR_KeyCacheGet( struct sata_xor_keycache* theCache, uint32_t numDwords ) {
+    uint32_t* key;
+
+    if( numDwords <= theCache->numDwords ) {
+        return theCache->key;
+    }
+    if( !xorStreamValid || !(key = realloc( theCache->key, numDwords * 4 )) ) {
+        return NULL;
+    }
+    if( theCache->numDwords == 0 ) {
+        theCache->state = 1;
+    }
+    // Carry on from where the cached stream ends
+    theCache->state = SATA_XOR_Generate( key + theCache->numDwords, theCache->state, numDwords - theCache->numDwords );
+    theCache->key = key;
+    theCache->numDwords = numDwords;
+    return key;
+}
+
+void SATA_XOR_KeyCacheFree( struct sata_xor_keycache* theCache ) {
+    free( theCache->key );
+    theCache->key = NULL;
+    theCache->numDwords = 0;
+}
+
+typedef void (*SATA_XOR_Fn)( uint32_t* theData, uint32_t numSectors );
+
+static void SATA_XOR_Scalar( uint32_t* theData, uint32_t numSectors ) {
+    uint32_t i;
+
+    while( numSectors-- ) {
+        for( i=0; i<(512/4); i++ ) {
+            theData[i] ^= SATA_XOR_scramblerdata[i];
+        }
+        theData += 512/4;
+    }
+}
+
+#ifdef SATA_XOR_HAVE_X86
+__attribute__((target("sse2")))
+static void SATA_XOR_SSE2( uint32_t* theData, uint32_t numSectors ) {
+    uint32_t i;
+
+    while( numSectors-- ) {
+        for( i=0; i<(512/4); i+=4 ) {
+            __m128i dw = _mm_loadu_si128( (const __m128i*)(theData + i) );
+            __m128i key = _mm_loadu_si128( (const __m128i*)(SATA_XOR_scramblerdata + i) );
+            _mm_storeu_si128( (__m128i*)(theData + i), _mm_xor_si128( dw, key ) );
+        }
+        theData += 512/4;
+    }
+}
+
+__attribute__((target("avx2")))
+static void SATA_XOR_AVX2( uint32_t* theData, uint32_t numSectors ) {
+    uint32_t i;
+
+    while( numSectors-- ) {
+        for( i=0; i<(512/4); i+=8 ) {
+            __m256i dw = _mm256_loadu_si256( (const __m256i*)(theData + i) );
+            __m256i key = _mm256_loadu_si256( (const __m256i*)(SATA_XOR_scramblerdata + i) );
+            _mm256_storeu_si256( (__m256i*)(theData + i), _mm256_xor_si256( dw, key ) );
+        }
+        theData += 512/4;
+    }
+}
+
+// The whole key stream fits in eight zmm registers, so it is only loaded once
+__attribute__((target("avx512f")))
+static void SATA_XOR_AVX512( uint32_t* theData, uint32_t numSectors ) {
+    __m512i key[8];
     uint32_t i;
 
-    for( i=0; i<(512/4); i++ ) {
-        theData[i] ^= SATA_XOR_scramblerdata[i];
+    for( i=0; i<8; i++ ) {
+        key[i] = _mm512_loadu_si512( SATA_XOR_scramblerdata + i*16 );
+    }
+    while( numSectors-- ) {
+        for( i=0; i<8; i++ ) {
+            __m512i dw = _mm512_loadu_si512( theData + i*16 );
+            _mm512_storeu_si512( theData + i*16, _mm512_xor_si512( dw, key[i] ) );
+        }
+        theData += 512/4;
+    }
+}
+#endif
+
+static const struct {
+    const char* name;
+    SATA_XOR_Fn fn;
+} xorEngines[] = {
+    [SATA_XOR_ENGINE_SCALAR] = { "scalar", SATA_XOR_Scalar },
+#ifdef SATA_XOR_HAVE_X86
+    [SATA_XOR_ENGINE_SSE2]   = { "sse2",   SATA_XOR_SSE2 },
+    [SATA_XOR_ENGINE_AVX2]   = { "avx2",   SATA_XOR_AVX2 },
+    [SATA_XOR_ENGINE_AVX512] = { "avx512", SATA_XOR_AVX512 },
+#else
+    [SATA_XOR_ENGINE_SSE2]   = { "sse2",   NULL },
+    [SATA_XOR_ENGINE_AVX2]   = { "avx2",   NULL },
+    [SATA_XOR_ENGINE_AVX512] = { "avx512", NULL },
+#endif
+};
+
+static int xorEngine = SATA_XOR_ENGINE_SCALAR;
+
+static int SATA_XOR_Supported( int engine ) {
+    if( engine < 0 || engine >= (int)(sizeof(xorEngines) / sizeof(xorEngines[0])) || !xorEngines[engine].fn ) {
+        return 0;
+    }
+#ifdef SATA_XOR_HAVE_X86
+    __builtin_cpu_init();
+    switch( engine ) {
+        case SATA_XOR_ENGINE_SSE2:   return __builtin_cpu_supports( "sse2" );
+        case SATA_XOR_ENGINE_AVX2:   return __builtin_cpu_supports( "avx2" );
+        case SATA_XOR_ENGINE_AVX512: return __builtin_cpu_supports( "avx512f" );
+    }
+#endif
+    return 1;
+}
+
+// Bit for bit check of an engine against the plain loop, over a few sectors
+static int SATA_XOR_Check( int engine ) {
+    uint32_t ref[3*512/4], buf[3*512/4];
+    uint32_t i, seed = 0x197b0325;
+
+    for( i = 0; i < 3*512/4; i++ ) {
+        seed = seed * 1103515245 + 12345;
+        ref[i] = buf[i] = seed;
+    }
+    SATA_XOR_Scalar( ref, 3 );
+    xorEngines[engine].fn( buf, 3 );
+    return memcmp( ref, buf, sizeof(buf) ) == 0;
+}
+
+int SATA_XOR_SetEngine( int engine ) {
+    if( engine == SATA_XOR_ENGINE_AUTO ) {
+        for( engine = SATA_XOR_ENGINE_AVX512; engine > SATA_XOR_ENGINE_SCALAR; engine-- ) {
+            if( SATA_XOR_Supported( engine ) && SATA_XOR_Check( engine ) ) {
+                break;
+            }
+        }
+    } else if( !SATA_XOR_Supported( engine ) ) {
+        return -1;
+    }
+    xorEngine = engine;
+    return 0;
+}
+
+const char* SATA_XOR_EngineName( int engine ) {
+    if( engine == SATA_XOR_ENGINE_AUTO ) {
+        engine = xorEngine;
+    }
+    return SATA_XOR_Supported( engine ) ? xorEngines[engine].name : NULL;
+}
+
+__attribute__((constructor))
+static void SATA_XOR_Init( void ) {
+    SATA_XOR_StreamInit();
+    SATA_XOR_SetEngine( SATA_XOR_ENGINE_AUTO );
+}
+
+void SATA_XOR( uint32_t* theData ) {
+    xorEngines[xorEngine].fn( theData, 1 );
+}
+
+void SATA_XOR_Sectors( uint32_t* theData, uint32_t numSectors ) {
+    xorEngines[xorEngine].fn( theData, numSectors );
+}
+
+
+// Engines without a fused variant get the CRC and SATA_XOR() as two passes,
+// which is what they would do anyway, but with the xor engine's SIMD loop
+void SATA_XOR_Encode( uint32_t* theData ) {
+    uint32_t myCRC;
+
+    if( !JM_CRC_Fused() ) {
+        theData[0x7f] = __cpu_to_le32( JM_CRC_Update( JM_CRC_INIT, theData, 0x7f ) );
+        SATA_XOR( theData );
+        return;
     }
+    myCRC = JM_CRC_Scramble( JM_CRC_INIT, theData, SATA_XOR_scramblerdata, 0x7f );
+    theData[0x7f] = __cpu_to_le32( myCRC ) ^ SATA_XOR_scramblerdata[0x7f];
 }
 
+uint32_t SATA_XOR_Decode( uint32_t* theData ) {
+    uint32_t myCRC;
+
+    if( !JM_CRC_Fused() ) {
+        SATA_XOR( theData );
+        return JM_CRC_Update( JM_CRC_INIT, theData, 0x7f );
+    }
+    myCRC = JM_CRC_Descramble( JM_CRC_INIT, theData, SATA_XOR_scramblerdata, 0x7f );
+    theData[0x7f] ^= SATA_XOR_scramblerdata[0x7f];
+    return myCRC;
+}
@@ -3,7 +3,50 @@
 
 #include <stdint.h>
 
+// Key stream for one sector
+extern const uint32_t SATA_XOR_scramblerdata[512/4];
+
+enum {
+    SATA_XOR_ENGINE_AUTO = -1,
+    SATA_XOR_ENGINE_SCALAR = 0, // One dword at a time, always available
+    SATA_XOR_ENGINE_SSE2,
+    SATA_XOR_ENGINE_AVX2,
+    SATA_XOR_ENGINE_AVX512,
+};
+
 void SATA_XOR( uint32_t* theData );
 
+// (De)scramble numSectors consecutive 512 byte sectors, each one on its own
+void SATA_XOR_Sectors( uint32_t* theData, uint32_t numSectors );
+
+// The key stream beyond the first sector, for payloads spanning several
+// sectors. dwordOffset counts from the start of the stream, so any chunk can
+// be generated (or xor:ed into theData) on its own. These return -1 if the
+// generator doesn't reproduce the table of the first sector
+uint32_t SATA_XOR_Seek( uint64_t dwordOffset );
+int SATA_XOR_Keystream( uint32_t* theKey, uint64_t dwordOffset, uint32_t numDwords );
+int SATA_XOR_Stream( uint32_t* theData, uint64_t dwordOffset, uint32_t numDwords );
+
+// A key stream generated once and extended on demand. Start from a zeroed struct
+struct sata_xor_keycache {
+    uint32_t* key;
+    uint32_t numDwords;
+    uint32_t state;     // LFSR state for dword numDwords
+};
+
+const uint32_t* SATA_XOR_KeyCacheGet( struct sata_xor_keycache* theCache, uint32_t numDwords );
+void SATA_XOR_KeyCacheFree( struct sata_xor_keycache* theCache );
+
+// Engine selection, normally picked at startup from the CPU features.
+// SATA_XOR_SetEngine returns -1 if the engine can't run on this machine
+int SATA_XOR_SetEngine( int engine );
+const char* SATA_XOR_EngineName( int engine );
+
+// Single pass framing of a sector: Encode stamps the CRC of the first 0x7f
+// dwords at 0x7f and scrambles, Decode descrambles and returns the CRC
+// calculated over the first 0x7f dwords (for comparing against dword 0x7f)
+void SATA_XOR_Encode( uint32_t* theData );
+uint32_t SATA_XOR_Decode( uint32_t* theData );
+
 #endif
 
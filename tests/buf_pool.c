@@ -0,0 +1,105 @@
+/*
+ * Repeated polls must not touch the heap for sector buffers: poll plain
+ * files standing in for controllers over the io_uring transport. A file
+ * reads back each command as it was written, correctly framed, which is
+ * what a sleeping controller does, so every probe also goes through the
+ * wakeup and the retry
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "jm_async.h"
+#include "jm_buf.h"
+#include "jmraid.h"
+
+#define POLLS     (100)
+#define CTRLS     (11)     // Three buffers each, one past what the pool holds
+#define DEV_BYTES ((JM_ASYNC_SECTOR + 1) * 512)
+
+static const uint8_t chip_probe[] = { 0x00, 0x01, 0x01, 0xff };
+static const uint8_t sata_probe[] = { 0x00, 0x02, 0x01, 0xff };
+
+static const struct jm_async_probe probes[] = {
+    { chip_probe, sizeof(chip_probe) },
+    { sata_probe, sizeof(sata_probe) },
+};
+
+int main(void) {
+    char path[CTRLS][32];
+    struct jm_async_ctrl ctrls[CTRLS];
+    uint8_t results[CTRLS][2 * 512];
+    unsigned long allocs = 0;
+    uint32_t scrambled_cmd;
+    int c, i, p, fd, failed = 0;
+
+    if (jmraid_controller_cmd("jms56x", &scrambled_cmd) < 0) {
+        printf("FAIL: no command for jms56x\n");
+        return 1;
+    }
+    for (c = 0; c < CTRLS; c++) {
+        snprintf(path[c], sizeof(path[c]), "buf_pool.%d.XXXXXX", c);
+        if ((fd = mkstemp(path[c])) < 0 || ftruncate(fd, DEV_BYTES) < 0) {
+            perror("buf_pool");
+            return 1;
+        }
+        close(fd);
+    }
+
+    for (i = 0; i < POLLS && !failed; i++) {
+        memset(ctrls, 0, sizeof(ctrls));
+        for (c = 0; c < CTRLS; c++) {
+            ctrls[c].path = path[c];
+            ctrls[c].scrambled_cmd = scrambled_cmd;
+            ctrls[c].probes = probes;
+            ctrls[c].numProbes = sizeof(probes) / sizeof(probes[0]);
+            ctrls[c].results = results[c];
+        }
+        if (JM_Async_Run(ctrls, CTRLS, JM_ASYNC_URING) != 0) {
+            // No io_uring or O_DIRECT here, nothing to measure
+            if (i == 0) {
+                printf("skip: polling a file over io_uring failed\n");
+                break;
+            }
+            printf("FAIL: poll %d failed\n", i);
+            failed = 1;
+        }
+        for (c = 0; c < CTRLS; c++) {
+            for (p = 0; p < (int)ctrls[c].numProbes; p++) {
+                if (!ctrls[c].error && ctrls[c].status[p] != JM_CMD_ASLEEP) {
+                    printf("FAIL: poll %d, %s: probe %d got status %u\n", i, path[c], p, ctrls[c].status[p]);
+                    failed = 1;
+                }
+            }
+        }
+        // The first poll warms the pool, from then on nothing may change
+        if (i == 0) {
+            allocs = JM_Buf_Allocs();
+        } else if (JM_Buf_Allocs() != allocs) {
+            printf("FAIL: poll %d: %lu heap allocations, %lu after the first\n", i, JM_Buf_Allocs(), allocs);
+            failed = 1;
+        }
+    }
+    for (c = 0; c < CTRLS; c++) {
+        unlink(path[c]);
+    }
+    printf("buf_pool: %d polls of %d controllers, %lu heap allocations\n", i, CTRLS, JM_Buf_Allocs());
+    return failed;
+}
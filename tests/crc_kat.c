@@ -0,0 +1,136 @@
+/*
+ * Known answer test of the CRC engines
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <asm/byteorder.h>
+#include "jm_crc.h"
+
+#define MAX_DWORDS (300)
+
+// Remainders from the original byte-wise JM_CRC, before there were engines
+static const struct {
+    const char *name;
+    int pattern;                // 0 zeroes, 1 byte counter, 2 all ones
+    uint32_t num_dwords;
+    uint32_t crc;
+} known[] = {
+    { "empty",       0, 0,   0x52325032 },
+    { "counter 1",   1, 1,   0x824b1fac },
+    { "zeroes 127",  0, 127, 0x5041bca6 },
+    { "counter 127", 1, 127, 0x0ecc71b4 },
+    { "ones 128",    2, 128, 0x2022b7ab },
+};
+
+static int failures;
+
+// Bit at a time over the same byte order as the engines, shares nothing with them
+static uint32_t crc_bitwise(uint32_t crc, const uint32_t *data, uint32_t num_dwords) {
+    uint32_t i;
+    int b, k;
+
+    for (i = 0; i < num_dwords; i++) {
+        uint32_t dw = __be32_to_cpu(data[i]);
+        for (b = 0; b < 4; b++) {
+            crc ^= ((dw >> (8 * b)) & 0xff) << 24;
+            for (k = 0; k < 8; k++) {
+                crc = crc & 0x80000000 ? (crc << 1) ^ 0x04c11db7 : crc << 1;
+            }
+        }
+    }
+    return crc;
+}
+
+static void fill(uint32_t *data, int pattern, uint32_t num_dwords) {
+    uint8_t *bytes = (uint8_t *)data;
+    uint32_t i;
+
+    for (i = 0; i < num_dwords * 4; i++) {
+        bytes[i] = pattern == 0 ? 0 : pattern == 1 ? i & 0xff : 0xff;
+    }
+}
+
+static void expect(const char *engine, const char *what, uint32_t n, uint32_t got, uint32_t want) {
+    if (got != want) {
+        printf("FAIL %s: %s, %u dwords: 0x%08x, expected 0x%08x\n", engine, what, n, got, want);
+        failures++;
+    }
+}
+
+static void check_engine(int engine) {
+    const char *name = JM_CRC_EngineName(engine);
+    uint32_t data[MAX_DWORDS], key[MAX_DWORDS], tmp[MAX_DWORDS];
+    uint32_t i, n, seed = 1;
+
+    for (i = 0; i < sizeof(known) / sizeof(known[0]); i++) {
+        fill(data, known[i].pattern, known[i].num_dwords);
+        expect(name, known[i].name, known[i].num_dwords, JM_CRC(data, known[i].num_dwords), known[i].crc);
+    }
+
+    for (i = 0; i < MAX_DWORDS; i++) {
+        seed = seed * 1103515245 + 12345;
+        data[i] = seed;
+        seed = seed * 1103515245 + 12345;
+        key[i] = seed;
+    }
+    // Every length, so each engine's head, bulk and tail paths all get their turn
+    for (n = 0; n <= MAX_DWORDS; n++) {
+        uint32_t want = crc_bitwise(JM_CRC_INIT, data, n);
+        uint32_t split = n / 3;
+
+        expect(name, "random", n, JM_CRC_Update(JM_CRC_INIT, data, n), want);
+        expect(name, "split", n, JM_CRC_Update(JM_CRC_Update(JM_CRC_INIT, data, split), data + split, n - split), want);
+
+        memcpy(tmp, data, n * 4);
+        expect(name, "scramble", n, JM_CRC_Scramble(JM_CRC_INIT, tmp, key, n), want);
+        for (i = 0; i < n; i++) {
+            if (tmp[i] != (data[i] ^ key[i])) {
+                expect(name, "scrambled data", n, tmp[i], data[i] ^ key[i]);
+                break;
+            }
+        }
+        expect(name, "descramble", n, JM_CRC_Descramble(JM_CRC_INIT, tmp, key, n), want);
+        if (memcmp(tmp, data, n * 4) != 0) {
+            printf("FAIL %s: descramble, %u dwords: data not restored\n", name, n);
+            failures++;
+        }
+    }
+}
+
+int main(void) {
+    int engine, tested = 0;
+
+    JM_CRC_Init();
+
+    // Remainder arithmetic: x^32 mod P is P without its top bit
+    expect("-", "x^32", 0, JM_CRC_XPow(32), 0x04c11db7);
+    expect("-", "x^100 * x^28", 0, JM_CRC_MulMod(JM_CRC_XPow(100), JM_CRC_XPow(28)), JM_CRC_XPow(128));
+
+    for (engine = JM_CRC_ENGINE_SCALAR; engine <= JM_CRC_ENGINE_PCLMUL; engine++) {
+        if (JM_CRC_SetEngine(engine) < 0) {
+            printf("skip engine %d: not supported here\n", engine);
+            continue;
+        }
+        check_engine(engine);
+        tested++;
+    }
+    JM_CRC_SetEngine(JM_CRC_ENGINE_AUTO);
+    printf("crc_kat: %d engines, %d failures\n", tested, failures);
+    return failures ? 1 : 0;
+}
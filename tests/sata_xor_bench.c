@@ -0,0 +1,110 @@
+/*
+ * Framing of one command/response pair: the four passes Do_JM_Cmd() used to
+ * make (CRC, scramble, descramble, CRC) against SATA_XOR_Encode/Decode, per
+ * CRC engine. Both have to produce the same bytes
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <asm/byteorder.h>
+#include "jm_crc.h"
+#include "sata_xor.h"
+
+#define ROUNDS (50000)
+#define RUNS   (5)      // The best run counts, the others saw interference
+
+static volatile uint32_t sink;
+
+static double now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static uint32_t separate(uint32_t *cmd, uint32_t *resp) {
+    cmd[0x7f] = __cpu_to_le32(JM_CRC(cmd, 0x7f));
+    SATA_XOR(cmd);
+    SATA_XOR(resp);
+    return JM_CRC(resp, 0x7f);
+}
+
+static uint32_t fused(uint32_t *cmd, uint32_t *resp) {
+    SATA_XOR_Encode(cmd);
+    return SATA_XOR_Decode(resp);
+}
+
+// ns per command/response pair. The buffers are scrambled back and forth,
+// only the time matters here
+static double bench(uint32_t (*frame)(uint32_t *, uint32_t *), uint32_t *cmd, uint32_t *resp) {
+    uint32_t i, run, crc = 0;
+    double best = 0;
+
+    for (run = 0; run < RUNS; run++) {
+        double start = now_ns(), t;
+
+        for (i = 0; i < ROUNDS; i++) {
+            crc ^= frame(cmd, resp);
+        }
+        t = (now_ns() - start) / ROUNDS;
+        if (run == 0 || t < best) {
+            best = t;
+        }
+    }
+    sink = crc;
+    return best;
+}
+
+int main(void) {
+    uint32_t cmd[2][128] __attribute__((aligned(64)));
+    uint32_t resp[2][128] __attribute__((aligned(64)));
+    uint32_t i, seed = 1, crc[2];
+    int engine, failures = 0;
+
+    for (i = 0; i < 128; i++) {
+        seed = seed * 1103515245 + 12345;
+        cmd[0][i] = seed;
+        seed = seed * 1103515245 + 12345;
+        resp[0][i] = seed;
+    }
+    JM_CRC_Init();
+
+    printf("%-8s %14s %19s %6s\n", "engine", "separate (ns)", "Encode/Decode (ns)", "fused");
+    for (engine = JM_CRC_ENGINE_SCALAR; engine <= JM_CRC_ENGINE_PCLMUL; engine++) {
+        double t_separate, t_fused;
+
+        if (JM_CRC_SetEngine(engine) < 0) {
+            continue;
+        }
+        memcpy(cmd[1], cmd[0], sizeof(cmd[0]));
+        memcpy(resp[1], resp[0], sizeof(resp[0]));
+        crc[0] = separate(cmd[0], resp[0]);
+        crc[1] = fused(cmd[1], resp[1]);
+        if (crc[0] != crc[1] || memcmp(cmd[0], cmd[1], sizeof(cmd[0])) != 0 ||
+            memcmp(resp[0], resp[1], sizeof(resp[0])) != 0) {
+            printf("FAIL %s: fused framing differs from the separate passes\n", JM_CRC_EngineName(engine));
+            failures++;
+        }
+        t_separate = bench(separate, cmd[0], resp[0]);
+        t_fused = bench(fused, cmd[1], resp[1]);
+        printf("%-8s %14.1f %19.1f %6s\n", JM_CRC_EngineName(engine), t_separate, t_fused, JM_CRC_Fused() ? "yes" : "no");
+    }
+    JM_CRC_SetEngine(JM_CRC_ENGINE_AUTO);
+    printf("sata_xor uses %s\n", SATA_XOR_EngineName(SATA_XOR_ENGINE_AUTO));
+    return failures ? 1 : 0;
+}